@@ -86,19 +86,23 @@ int main( int argc, char const** argv )
   /* 4) Create trees and add roots         */
   /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
 
-  puu_tree<Individual> lineage_tree;
-  puu_tree<Individual> coalescence_tree;
+  puu_tree<Individual> lineage_tree(LIVE_LINEAGE);
 
   for (int i = 0; i < population_size; i++)
   {
     lineage_tree.add_root(simulation.get_individual(i));
-    coalescence_tree.add_root(simulation.get_individual(i));
   }
 
   /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
   /* 5) Evolve the population              */
   /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
 
+  std::vector<Individual*> parents;
+  std::vector<Individual*> descendants;
+  std::vector<Individual*> population(population_size, NULL);
+  parents.reserve(population_size);
+  descendants.reserve(population_size);
+
   for (int generation = 1; generation <= simulation_time; generation++)
   {
     if (generation%1000==0)
@@ -112,34 +116,36 @@ int main( int argc, char const** argv )
 
     /* STEP 2 : Add reproduction events
        --------------------------------- */
+    parents.clear();
+    descendants.clear();
     Individual* parent;
     Individual* descendant;
     std::tie(parent, descendant) = simulation.get_first_parent_descendant_pair();
     while (parent != NULL)
     {
-      lineage_tree.add_reproduction_event(parent, descendant, (double)generation);
-      coalescence_tree.add_reproduction_event(parent, descendant, (double)generation);
+      parents.push_back(parent);
+      descendants.push_back(descendant);
       std::tie(parent, descendant) = simulation.get_next_parent_descendant_pair();
     }
+    lineage_tree.add_reproduction_events(parents, descendants, (double)generation);
 
     /* STEP 3 : Inactivate parents
        ---------------------------- */
     for (int i = 0; i < population_size; i++)
     {
-      lineage_tree.inactivate(simulation.get_individual(i), true);
-      coalescence_tree.inactivate(simulation.get_individual(i), false);
+      population[i] = simulation.get_individual(i);
     }
+    lineage_tree.inactivate_all(population, true);
 
     /* STEP 4 : Replace the current population with the new one
        --------------------------------------------------------- */
     simulation.update_population();
 
-    /* STEP 5: Update the lineage and coalescence trees
-       ------------------------------------------------- */
+    /* STEP 5: Update the lineage tree
+       -------------------------------- */
     if (generation%100==0)
     {
       lineage_tree.update_as_lineage_tree();
-      coalescence_tree.update_as_coalescence_tree();
     }
 
   }
@@ -149,43 +155,25 @@ int main( int argc, char const** argv )
   /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
 
   lineage_tree.update_as_lineage_tree();
-  coalescence_tree.update_as_coalescence_tree();
+
+  /* Columns of lineage files
+     ------------------------- */
+  std::vector< std::pair<std::string, std::function<double(const Individual&)> > > columns;
+  columns.push_back(std::make_pair("mutation_size", &Individual::get_mutation_size));
+  columns.push_back(std::make_pair("trait", &Individual::get_trait));
+  columns.push_back(std::make_pair("fitness", &Individual::get_fitness));
 
   /* Save the lineage of the last best individual
      --------------------------------------------- */
-  std::ofstream file("./output/lineage_best.txt", std::ios::out | std::ios::trunc);
-  file << "generation mutation_size trait fitness" << std::endl;
-  puu_node<Individual>* best_node = lineage_tree.get_node_by_selection_unit(simulation.get_best_individual());
-  while (best_node != NULL)
-  {
-    file << best_node->get_insertion_time() << " ";
-    file << best_node->get_selection_unit()->get_mutation_size() << " ";
-    file << best_node->get_selection_unit()->get_trait() << " ";
-    file << best_node->get_selection_unit()->get_fitness() << std::endl;
-    best_node = best_node->get_parent();
-    file.flush();
-  }
-  file.close();
+  lineage_tree.write_line_of_descent("./output/lineage_best.txt", simulation.get_best_individual(), "generation", columns);
 
   /* Save the lineage of all alive individuals
      ------------------------------------------ */
-  file.open("./output/lineage_all.txt", std::ios::out | std::ios::trunc);
-  file << "generation mutation_size trait fitness" << std::endl;
-  puu_node<Individual>* node = lineage_tree.get_first();
-  while (node != NULL)
-  {
-    file << node->get_insertion_time() << " ";
-    file << node->get_selection_unit()->get_mutation_size() << " ";
-    file << node->get_selection_unit()->get_trait() << " ";
-    file << node->get_selection_unit()->get_fitness() << std::endl;
-    file.flush();
-    node = lineage_tree.get_next();
-  }
-  file.close();
+  lineage_tree.write_lineage_table("./output/lineage_all.txt", "generation", columns);
 
   /* Save the coalescence tree
      -------------------------- */
-  coalescence_tree.write_newick_tree("./output/coalescence_tree.phb");
+  lineage_tree.write_coalescence_newick_tree("./output/coalescence_tree.phb");
 
   return EXIT_SUCCESS;
 }
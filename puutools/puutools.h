@@ -35,10 +35,38 @@
 #define __puutools__
 
 #include <iostream>
+#include <cstdio>
+#include <cassert>
 #include <fstream>
 #include <sstream>
 #include <vector>
 #include <unordered_map>
+#include <new>
+#include <algorithm>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <list>
+#include <map>
+#include <set>
+#include <tuple>
+#include <type_traits>
+#include <cstdlib>
+#include <cmath>
+#include <climits>
+#if defined(PUUTOOLS_USE_MMAP) && (defined(__unix__) || defined(__APPLE__))
+#define PUUTOOLS_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#if defined(__has_include)
+#if __has_include(<charconv>) && __cplusplus >= 201703L
+#include <charconv>
+#endif
+#endif
 
 /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
 /* Node class enumeration                                                     */
@@ -56,15 +84,52 @@ enum puu_node_class
 };
 
 /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-/* puu_node class declarations and definitions                                */
+/* Update mode enumeration                                                    */
 /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
 
 /**
- * \brief   puu_node class declaration
- * \details The puu_node class manages a lineage or coalescence node
+ * \brief   Update mode
+ * \details Defines when the tree structure is maintained. With deferred updates,
+ *          dead branches are only removed by update_as_lineage_tree() or
+ *          update_as_coalescence_tree(). With live updates, they are removed
+ *          as soon as the last active descendant dies, and a live coalescence
+ *          tree also drops dead nodes as soon as they are left with one child.
  */
-template <typename selection_unit>
-class puu_node
+enum puu_update_mode
+{
+  DEFERRED_UPDATES = 0, /*!< The tree is only updated on demand                       */
+  LIVE_LINEAGE     = 1, /*!< Extinct branches are removed at each inactivation          */
+  LIVE_COALESCENCE = 2  /*!< Dead nodes which are not common ancestors are also removed */
+};
+
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+/* Node handle structure                                                      */
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+/**
+ * \brief   Node handle
+ * \details Lightweight reference to a node returned by the tree when the node
+ *          is created. The handle remains valid until the node is deleted,
+ *          and allows to reach the node without any map lookup.
+ */
+struct puu_handle
+{
+  size_t       slot;       /*!< Slot of the node in the node pool       */
+  unsigned int generation; /*!< Generation of the slot when it was used */
+};
+
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+/* puu_output_buffer class declarations and definitions                       */
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+/**
+ * \brief   puu_output_buffer class declaration
+ * \details The puu_output_buffer class accumulates text in a fixed-size
+ *          buffer, and writes it to a file each time the buffer is full. It is
+ *          used by the tree exporters, so that large trees are written with a
+ *          bounded amount of memory.
+ */
+class puu_output_buffer
 {
 
 public:
@@ -72,54 +137,34 @@ public:
   /*----------------------------
    * CONSTRUCTORS
    *----------------------------*/
-  puu_node( void ) = delete;
-  puu_node( unsigned long long int identifier );
-  puu_node( unsigned long long int identifier, double time, selection_unit* unit );
-  puu_node( const puu_node& node ) = delete;
+  puu_output_buffer( void ) = delete;
+  puu_output_buffer( std::ofstream& file, size_t capacity );
+  puu_output_buffer( const puu_output_buffer& buffer ) = delete;
 
   /*----------------------------
    * DESTRUCTORS
    *----------------------------*/
-  ~puu_node( void );
+  ~puu_output_buffer( void );
 
   /*----------------------------
    * GETTERS
    *----------------------------*/
-  inline unsigned long long int get_identifier( void ) const;
-  inline double                 get_insertion_time( void ) const;
-  inline selection_unit*        get_selection_unit( void );
-  inline puu_node*              get_previous( void );
-  inline puu_node*              get_parent( void );
-  inline puu_node*              get_child( size_t pos );
-  inline size_t                 get_number_of_children( void ) const;
-  inline puu_node_class         get_node_class( void ) const;
-  inline bool                   is_master_root( void ) const;
-  inline bool                   is_root( void ) const;
-  inline bool                   is_normal( void ) const;
-  inline bool                   is_ancestor( unsigned long long int ancestor_id ) const;
-  inline bool                   is_active( void ) const;
-  inline bool                   is_tagged( void ) const;
+  inline int get_precision( void ) const;
 
   /*----------------------------
    * SETTERS
    *----------------------------*/
-  puu_node& operator=(const puu_node&) = delete;
-
-  inline void set_parent( puu_node* node );
-  inline void as_root( void );
-  inline void as_normal( void );
-  inline void inactivate( bool copy );
-  inline void tag( void );
-  inline void untag( void );
+  puu_output_buffer& operator=(const puu_output_buffer&) = delete;
+  inline void set_precision( int precision );
 
   /*----------------------------
    * PUBLIC METHODS
    *----------------------------*/
-  void add_child( puu_node* node );
-  void remove_child( puu_node* node );
-  void replace_by_grandchildren( puu_node* child_to_remove );
-  void tag_lineage( void );
-  void untag_lineage( void );
+  inline void append( char c );
+  inline void append( const char* str, size_t length );
+  inline void append( unsigned long long int value );
+  inline void append( double value );
+  inline void flush( void );
 
   /*----------------------------
    * PUBLIC ATTRIBUTES
@@ -130,19 +175,16 @@ protected:
   /*----------------------------
    * PROTECTED METHODS
    *----------------------------*/
+  inline void ensure( size_t length );
+  inline void append_general( double value, int precision );
 
   /*----------------------------
    * PROTECTED ATTRIBUTES
    *----------------------------*/
-  unsigned long long int _identifier;     /*!< Node identifier                                 */
-  double                 _insertion_time; /*!< Node's insertion time                           */
-  selection_unit*        _selection_unit; /*!< Attached selection unit                         */
-  puu_node*              _parent;         /*!< Parental node                                   */
-  std::vector<puu_node*> _children;       /*!< Node's children                                 */
-  puu_node_class         _node_class;     /*!< Node class (master root, root or normal)        */
-  bool                   _active;         /*!< Indicates if the node is active                 */
-  bool                   _tagged;         /*!< Indicates if the node is tagged                 */
-  bool                   _copy;           /*!< Indicates if the selection unit has been copied */
+  std::ofstream*    _file;      /*!< Output file                                     */
+  std::vector<char> _buffer;    /*!< Text buffer                                     */
+  size_t            _size;      /*!< Number of buffered chars                        */
+  int               _precision; /*!< Significant digits of doubles (0 for shortest)  */
 };
 
 /*----------------------------
@@ -150,475 +192,547 @@ protected:
  *----------------------------*/
 
 /**
- * \brief    Get node's identifier
- * \details  --
- * \param    void
- * \return   \e unsigned long long int
- */
-template <typename selection_unit>
-inline unsigned long long int puu_node<selection_unit>::get_identifier( void ) const
-{
-  return _identifier;
-}
-
-/**
- * \brief    Get node's insertion time
- * \details  --
+ * \brief    Get the number of significant digits of doubles
+ * \details  0 stands for the shortest representation that reads back exactly
  * \param    void
- * \return   \e double
+ * \return   \e int
  */
-template <typename selection_unit>
-inline double puu_node<selection_unit>::get_insertion_time( void ) const
+inline int puu_output_buffer::get_precision( void ) const
 {
-  return _insertion_time;
+  return _precision;
 }
 
-/**
- * \brief    Get the selection unit
- * \details  --
- * \param    void
- * \return   \e selection_unit*
- */
-template <typename selection_unit>
-inline selection_unit* puu_node<selection_unit>::get_selection_unit( void )
-{
-  return _selection_unit;
-}
+/*----------------------------
+ * SETTERS
+ *----------------------------*/
 
 /**
- * \brief    Get the previous node
- * \details  --
- * \param    void
- * \return   \e puu_node*
+ * \brief    Set the number of significant digits of doubles
+ * \details  0 stands for the shortest representation that reads back exactly
+ * \param    int precision
+ * \return   \e void
  */
-template <typename selection_unit>
-inline puu_node<selection_unit>* puu_node<selection_unit>::get_previous( void )
+inline void puu_output_buffer::set_precision( int precision )
 {
-  return _parent;
+  assert(precision >= 0 && precision <= 17);
+  _precision = precision;
 }
 
-/**
- * \brief    Get the parental node
- * \details  Returns also NULL if the parent is the master root
- * \param    void
- * \return   \e puu_node*
- */
-template <typename selection_unit>
-inline puu_node<selection_unit>* puu_node<selection_unit>::get_parent( void )
-{
-  if (_parent != NULL && _parent->is_master_root())
-  {
-    return NULL;
-  }
-  return _parent;
-}
+/*----------------------------
+ * CONSTRUCTORS
+ *----------------------------*/
 
 /**
- * \brief    Get the child at position 'pos'
+ * \brief    Constructor
  * \details  --
- * \param    void
- * \return   \e puu_node*
+ * \param    std::ofstream& file
+ * \param    size_t capacity
+ * \return   \e void
  */
-template <typename selection_unit>
-inline puu_node<selection_unit>* puu_node<selection_unit>::get_child( size_t pos )
+inline puu_output_buffer::puu_output_buffer( std::ofstream& file, size_t capacity )
 {
-  assert(pos < _children.size());
-  return _children[pos];
+  assert(capacity >= 64);
+  _file = &file;
+  _buffer.resize(capacity);
+  _size      = 0;
+  _precision = 6;
 }
 
-/**
- * \brief    Get the number of children
- * \details  --
- * \param    void
- * \return   \e puu_node*
- */
-template <typename selection_unit>
-inline size_t puu_node<selection_unit>::get_number_of_children( void ) const
-{
-  return _children.size();
-}
+/*----------------------------
+ * DESTRUCTORS
+ *----------------------------*/
 
 /**
- * \brief    Get the node class
- * \details  --
+ * \brief    Destructor
+ * \details  Writes the remaining text
  * \param    void
- * \return   \e puu_node_class
+ * \return   \e void
  */
-template <typename selection_unit>
-inline puu_node_class puu_node<selection_unit>::get_node_class( void ) const
+inline puu_output_buffer::~puu_output_buffer( void )
 {
-  return _node_class;
+  flush();
+  _file = NULL;
 }
 
+/*----------------------------
+ * PUBLIC METHODS
+ *----------------------------*/
+
 /**
- * \brief    Check if the node is the master root
+ * \brief    Appends a character
  * \details  --
- * \param    void
- * \return   \e bool
+ * \param    char c
+ * \return   \e void
  */
-template <typename selection_unit>
-inline bool puu_node<selection_unit>::is_master_root( void ) const
+inline void puu_output_buffer::append( char c )
 {
-  return (_node_class == MASTER_ROOT);
+  ensure(1);
+  _buffer[_size] = c;
+  _size++;
 }
 
 /**
- * \brief    Check if the node is a root
+ * \brief    Appends a string of 'length' characters
  * \details  --
- * \param    void
- * \return   \e bool
+ * \param    const char* str
+ * \param    size_t length
+ * \return   \e void
  */
-template <typename selection_unit>
-inline bool puu_node<selection_unit>::is_root( void ) const
+inline void puu_output_buffer::append( const char* str, size_t length )
 {
-  return (_node_class == ROOT);
+  if (length > _buffer.size())
+  {
+    flush();
+    _file->write(str, length);
+    return;
+  }
+  ensure(length);
+  memcpy(&_buffer[_size], str, length);
+  _size += length;
 }
 
 /**
- * \brief    Check if the node is normal
- * \details  --
- * \param    void
- * \return   \e bool
+ * \brief    Appends an unsigned integer
+ * \details  Digits are written without going through the C library
+ * \param    unsigned long long int value
+ * \return   \e void
  */
-template <typename selection_unit>
-inline bool puu_node<selection_unit>::is_normal( void ) const
+inline void puu_output_buffer::append( unsigned long long int value )
 {
-  return (_node_class == NORMAL);
+  char   digits[20];
+  size_t length = 0;
+  do
+  {
+    digits[19-length] = (char)('0'+value%10);
+    value            /= 10;
+    length++;
+  } while (value > 0);
+  append(&digits[20-length], length);
 }
 
 /**
- * \brief    Check if the given identifier is an ancestor
- * \details  --
- * \param    unsigned long long int ancestor_id
- * \return   \e bool
+ * \brief    Appends a floating point number
+ * \details  With a non-zero precision, the text is the one of printf("%.*g")
+ *           (6 digits being the default std::ostream format). With a zero
+ *           precision, it is the shortest text which reads back to the same
+ *           double. Integral values are written as integers directly, and the
+ *           decimal separator is always a dot whatever the locale.
+ * \param    double value
+ * \return   \e void
  */
-template <typename selection_unit>
-inline bool puu_node<selection_unit>::is_ancestor( unsigned long long int ancestor_id ) const
+inline void puu_output_buffer::append( double value )
 {
-  puu_node* node = get_previous();
-  while (node != NULL)
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 1) Integral values                */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  double limit = (_precision == 0 ? 9007199254740992.0 : 1.0);
+  for (int i = 0; i < _precision; i++)
+  {
+    limit *= 10.0;
+  }
+  if (value == std::floor(value) && std::fabs(value) < limit)
   {
-    if (node->get_id() == ancestor_id)
+    if (std::signbit(value))
     {
-      return true;
+      append('-');
     }
-    node = node->get_previous();
+    append((unsigned long long int)std::fabs(value));
+    return;
   }
-  return false;
-}
 
-/**
- * \brief    Check if the node is active or inactive
- * \details  --
- * \param    void
- * \return   \e bool
- */
-template <typename selection_unit>
-inline bool puu_node<selection_unit>::is_active( void ) const
-{
-  return _active;
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 2) Fixed precision                */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  ensure(32);
+  if (_precision > 0)
+  {
+    append_general(value, _precision);
+    return;
+  }
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 3) Shortest round-trip text       */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+#if defined(__cpp_lib_to_chars)
+  std::to_chars_result result = std::to_chars(&_buffer[_size], &_buffer[_size]+32, value);
+  _size                       = (size_t)(result.ptr-&_buffer[0]);
+#else
+  char text[32];
+  for (int precision = 1; precision <= 17; precision++)
+  {
+    snprintf(text, 32, "%.*g", precision, value);
+    if (precision == 17 || strtod(text, NULL) == value)
+    {
+      append_general(value, precision);
+      return;
+    }
+  }
+#endif
 }
 
 /**
- * \brief    Check if the node is tagged or not
+ * \brief    Writes the buffered text to the file
  * \details  --
  * \param    void
- * \return   \e bool
+ * \return   \e void
  */
-template <typename selection_unit>
-inline bool puu_node<selection_unit>::is_tagged( void ) const
+inline void puu_output_buffer::flush( void )
 {
-  return _tagged;
+  if (_size > 0)
+  {
+    _file->write(&_buffer[0], (std::streamsize)_size);
+    _size = 0;
+  }
 }
 
 /*----------------------------
- * SETTERS
+ * PROTECTED METHODS
  *----------------------------*/
 
 /**
- * \brief    Add a parent
- * \details  --
- * \param    puu_node* node
+ * \brief    Appends a double with 'precision' significant digits
+ * \details  The caller must make room for 32 characters. The decimal separator
+ *           of the current locale is replaced by a dot.
+ * \param    double value
+ * \param    int precision
  * \return   \e void
  */
-template <typename selection_unit>
-inline void puu_node<selection_unit>::set_parent( puu_node* node )
+inline void puu_output_buffer::append_general( double value, int precision )
 {
-  _parent = node;
+  char* text   = &_buffer[_size];
+  int   length = snprintf(text, 32, "%.*g", precision, value);
+  assert(length > 0 && length < 32);
+  for (int i = 0; i < length; i++)
+  {
+    char c = text[i];
+    if (!((c >= '0' && c <= '9') || c == '-' || c == '+' || c == 'e' || c == 'n' || c == 'a' || c == 'i' || c == 'f'))
+    {
+      text[i] = '.';
+    }
+  }
+  _size += (size_t)length;
 }
 
 /**
- * \brief    Set the node class as root
+ * \brief    Makes room for 'length' characters
  * \details  --
- * \param    void
+ * \param    size_t length
  * \return   \e void
  */
-template <typename selection_unit>
-inline void puu_node<selection_unit>::as_root( void )
+inline void puu_output_buffer::ensure( size_t length )
 {
-  _node_class = ROOT;
+  if (_size+length > _buffer.size())
+  {
+    flush();
+  }
 }
 
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+/* puu_small_vector class declarations and definitions                        */
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
 /**
- * \brief    Set the node class as normal
- * \details  --
- * \param    void
- * \return   \e void
+ * \brief   puu_small_vector class declaration
+ * \details The puu_small_vector class is a vector of trivially copyable values
+ *          (e.g. pointers) which stores up to 'inline_capacity' values inside
+ *          the object itself, and only moves them to the heap beyond. It is
+ *          used to store node children, most nodes having few of them.
  */
-template <typename selection_unit>
-inline void puu_node<selection_unit>::as_normal( void )
+template <typename value_type, size_t inline_capacity>
+class puu_small_vector
 {
-  _node_class = NORMAL;
-}
 
-/** @
- * \brief    Inactivate the node
- * \details  --
- * \param    selection_unit* unit
- * \param    bool copy
- * \return   \e void
- */
-template <typename selection_unit>
-inline void puu_node<selection_unit>::inactivate( bool copy )
-{
-  if (copy)
-  {
-    _selection_unit = new selection_unit(*_selection_unit);
-  }
-  else
+public:
+
+  /*----------------------------
+   * CONSTRUCTORS
+   *----------------------------*/
+  puu_small_vector( void );
+  puu_small_vector( const puu_small_vector& vector ) = delete;
+
+  /*----------------------------
+   * DESTRUCTORS
+   *----------------------------*/
+  ~puu_small_vector( void );
+
+  /*----------------------------
+   * GETTERS
+   *----------------------------*/
+  inline size_t            size( void ) const;
+  inline size_t            capacity( void ) const;
+  inline bool              empty( void ) const;
+  inline value_type*       data( void );
+  inline const value_type* data( void ) const;
+  inline value_type&       operator[]( size_t pos );
+  inline const value_type& operator[]( size_t pos ) const;
+  inline value_type&       back( void );
+
+  /*----------------------------
+   * SETTERS
+   *----------------------------*/
+  puu_small_vector& operator=(const puu_small_vector&) = delete;
+
+  /*----------------------------
+   * PUBLIC METHODS
+   *----------------------------*/
+  inline void push_back( const value_type& value );
+  inline void pop_back( void );
+  inline void clear( void );
+  void        reserve( size_t new_capacity );
+
+  /*----------------------------
+   * PUBLIC ATTRIBUTES
+   *----------------------------*/
+
+protected:
+
+  /*----------------------------
+   * PROTECTED METHODS
+   *----------------------------*/
+
+  /*----------------------------
+   * PROTECTED ATTRIBUTES
+   *----------------------------*/
+  unsigned int _size;     /*!< Number of values                        */
+  unsigned int _capacity; /*!< Number of values that fit in the buffer */
+  union
   {
-    _selection_unit = NULL;
-  }
-  _active = false;
-  _copy   = copy;
+    value_type  _inline[inline_capacity]; /*!< Inline buffer */
+    value_type* _heap;                    /*!< Heap buffer   */
+  };
+};
+
+/*----------------------------
+ * GETTERS
+ *----------------------------*/
+
+/**
+ * \brief    Get the number of values
+ * \details  --
+ * \param    void
+ * \return   \e size_t
+ */
+template <typename value_type, size_t inline_capacity>
+inline size_t puu_small_vector<value_type, inline_capacity>::size( void ) const
+{
+  return _size;
 }
 
 /**
- * \brief    Tag the node
+ * \brief    Get the number of values that fit without reallocation
  * \details  --
  * \param    void
- * \return   \e void
+ * \return   \e size_t
  */
-template <typename selection_unit>
-inline void puu_node<selection_unit>::tag( void )
+template <typename value_type, size_t inline_capacity>
+inline size_t puu_small_vector<value_type, inline_capacity>::capacity( void ) const
 {
-  _tagged = true;
+  return _capacity;
 }
 
 /**
- * \brief    Untag the node
+ * \brief    Check if the vector is empty
  * \details  --
  * \param    void
- * \return   \e void
+ * \return   \e bool
  */
-template <typename selection_unit>
-inline void puu_node<selection_unit>::untag( void )
+template <typename value_type, size_t inline_capacity>
+inline bool puu_small_vector<value_type, inline_capacity>::empty( void ) const
 {
-  _tagged = false;
+  return (_size == 0);
 }
 
-/*----------------------------
- * CONSTRUCTORS
- *----------------------------*/
+/**
+ * \brief    Get the buffer
+ * \details  --
+ * \param    void
+ * \return   \e value_type*
+ */
+template <typename value_type, size_t inline_capacity>
+inline value_type* puu_small_vector<value_type, inline_capacity>::data( void )
+{
+  return (_capacity > inline_capacity ? _heap : _inline);
+}
 
 /**
- * \brief    Constructor
- * \details  Creates a MASTER_ROOT node
- * \param    unsigned long long int identifier
- * \return   \e void
+ * \brief    Get the buffer
+ * \details  --
+ * \param    void
+ * \return   \e const value_type*
  */
-template <typename selection_unit>
-puu_node<selection_unit>::puu_node( unsigned long long int identifier )
+template <typename value_type, size_t inline_capacity>
+inline const value_type* puu_small_vector<value_type, inline_capacity>::data( void ) const
 {
-  _identifier     = identifier;
-  _insertion_time = 0.0;
-  _selection_unit = NULL;
-  _parent         = NULL;
-  _node_class     = MASTER_ROOT;
-  _active         = false;
-  _tagged         = false;
-  _copy           = false;
-  _children.clear();
+  return (_capacity > inline_capacity ? _heap : _inline);
 }
 
 /**
- * \brief    Active node constructor
- * \details  Creates a new active node with its attached selection unit.
- * \param    unsigned long long int identifier
- * \param    double time
- * \param    selection_unit* unit
- * \return   \e void
+ * \brief    Get the value at position 'pos'
+ * \details  --
+ * \param    size_t pos
+ * \return   \e value_type&
  */
-template <typename selection_unit>
-puu_node<selection_unit>::puu_node( unsigned long long int identifier, double time, selection_unit* unit )
+template <typename value_type, size_t inline_capacity>
+inline value_type& puu_small_vector<value_type, inline_capacity>::operator[]( size_t pos )
 {
-  assert(time >= 0.0);
-  assert(unit != NULL);
-  _identifier     = identifier;
-  _insertion_time = time;
-  _selection_unit = unit;
-  _parent         = NULL;
-  _node_class     = NORMAL;
-  _active         = true;
-  _tagged         = false;
-  _copy           = false;
-  _children.clear();
+  assert(pos < _size);
+  return data()[pos];
+}
+
+/**
+ * \brief    Get the value at position 'pos'
+ * \details  --
+ * \param    size_t pos
+ * \return   \e const value_type&
+ */
+template <typename value_type, size_t inline_capacity>
+inline const value_type& puu_small_vector<value_type, inline_capacity>::operator[]( size_t pos ) const
+{
+  assert(pos < _size);
+  return data()[pos];
+}
+
+/**
+ * \brief    Get the last value
+ * \details  --
+ * \param    void
+ * \return   \e value_type&
+ */
+template <typename value_type, size_t inline_capacity>
+inline value_type& puu_small_vector<value_type, inline_capacity>::back( void )
+{
+  assert(_size > 0);
+  return data()[_size-1];
 }
 
 /*----------------------------
- * DESTRUCTORS
+ * CONSTRUCTORS
  *----------------------------*/
 
 /**
- * \brief    Destructor
+ * \brief    Default constructor
  * \details  --
  * \param    void
  * \return   \e void
  */
-template <typename selection_unit>
-puu_node<selection_unit>::~puu_node( void )
+template <typename value_type, size_t inline_capacity>
+puu_small_vector<value_type, inline_capacity>::puu_small_vector( void )
 {
-  if (_copy)
-  {
-    delete _selection_unit;
-  }
-  _selection_unit = NULL;
-  _children.clear();
+  _size     = 0;
+  _capacity = (unsigned int)inline_capacity;
 }
 
 /*----------------------------
- * PUBLIC METHODS
+ * DESTRUCTORS
  *----------------------------*/
 
 /**
- * \brief    Adds a child
+ * \brief    Destructor
  * \details  --
- * \param    puu_node* node
+ * \param    void
  * \return   \e void
  */
-template <typename selection_unit>
-void puu_node<selection_unit>::add_child( puu_node* node )
+template <typename value_type, size_t inline_capacity>
+puu_small_vector<value_type, inline_capacity>::~puu_small_vector( void )
 {
-  for (size_t i = 0; i < _children.size(); i++)
+  if (_capacity > inline_capacity)
   {
-    assert(node->get_identifier() != _children[i]->get_identifier());
+    ::operator delete(_heap);
   }
-  _children.push_back(node);
 }
 
+/*----------------------------
+ * PUBLIC METHODS
+ *----------------------------*/
+
 /**
- * \brief    Removes a child
+ * \brief    Adds a value at the end
  * \details  --
- * \param    puu_node* node
+ * \param    const value_type& value
  * \return   \e void
  */
-template <typename selection_unit>
-void puu_node<selection_unit>::remove_child( puu_node* node )
+template <typename value_type, size_t inline_capacity>
+inline void puu_small_vector<value_type, inline_capacity>::push_back( const value_type& value )
 {
-  int pos = -1;
-  for (size_t i = 0; i < _children.size(); i++)
-  {
-    if (node->get_identifier() == _children[i]->get_identifier() && pos == -1)
-    {
-      pos = (int)i;
-    }
-    else if (node->get_identifier() == _children[i]->get_identifier() && pos >= 0)
-    {
-      printf("Error in Node::remove_child(): multiple occurences of a node in the list of children. Exit.\n");
-      exit(EXIT_FAILURE);
-    }
-  }
-  if (pos == -1)
-  {
-    printf("Error in Node::remove_child(): the node to remove does not exist. Exit.\n");
-    exit(EXIT_FAILURE);
-  }
-  else
+  if (_size == _capacity)
   {
-    _children.erase(_children.begin()+pos);
+    reserve(2*(size_t)_capacity);
   }
+  data()[_size] = value;
+  _size++;
 }
 
 /**
- * \brief    Replaces the given child by its own children
+ * \brief    Removes the last value
  * \details  --
- * \param    puu_node* child_to_remove
+ * \param    void
  * \return   \e void
  */
-template <typename selection_unit>
-void puu_node<selection_unit>::replace_by_grandchildren( puu_node* child_to_remove )
+template <typename value_type, size_t inline_capacity>
+inline void puu_small_vector<value_type, inline_capacity>::pop_back( void )
 {
-  remove_child(child_to_remove);
-  for (size_t i = 0; i < child_to_remove->get_number_of_children(); i++)
-  {
-    add_child(child_to_remove->get_child(i));
-  }
+  assert(_size > 0);
+  _size--;
 }
 
 /**
- * \brief    Tags the lineage of the node
- * \details  --
+ * \brief    Removes all the values
+ * \details  The buffer is kept
  * \param    void
  * \return   \e void
  */
-template <typename selection_unit>
-void puu_node<selection_unit>::tag_lineage( void )
+template <typename value_type, size_t inline_capacity>
+inline void puu_small_vector<value_type, inline_capacity>::clear( void )
 {
-  _tagged        = true;
-  puu_node* node = _parent;
-  while (node != NULL)
-  {
-    node->tag();
-    node = node->get_previous();
-    if (node != NULL)
-    {
-      if (node->is_tagged())
-      {
-        node = NULL;
-      }
-    }
-  }
+  _size = 0;
 }
 
 /**
- * \brief    Untags the lineage of the node
- * \details  --
- * \param    void
+ * \brief    Makes sure that 'new_capacity' values fit without reallocation
+ * \details  Values are moved to the heap if they do not fit inline anymore
+ * \param    size_t new_capacity
  * \return   \e void
  */
-template <typename selection_unit>
-void puu_node<selection_unit>::untag_lineage( void )
+template <typename value_type, size_t inline_capacity>
+void puu_small_vector<value_type, inline_capacity>::reserve( size_t new_capacity )
 {
-  _tagged        = false;
-  puu_node* node = _parent;
-  while (node != NULL)
+  if (new_capacity <= _capacity)
   {
-    node->untag();
-    node = node->get_previous();
-    if (node != NULL)
-    {
-      if (!node->is_tagged())
-      {
-        node = NULL;
-      }
-    }
+    return;
+  }
+  value_type* buffer = static_cast<value_type*>(::operator new(new_capacity*sizeof(value_type)));
+  memcpy(buffer, data(), _size*sizeof(value_type));
+  if (_capacity > inline_capacity)
+  {
+    ::operator delete(_heap);
   }
+  _heap     = buffer;
+  _capacity = (unsigned int)new_capacity;
 }
 
-/*----------------------------
- * PROTECTED METHODS
- *----------------------------*/
-
 /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-/* puu_tree class declarations and definitions                                */
+/* puu_snapshot class declarations and definitions                            */
 /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
 
+template <typename selection_unit>
+class puu_delta_codec;
+
+template <typename selection_unit>
+class puu_snapshot_store;
+
 /**
- * \brief   puu_tree class declaration
- * \details The puu_tree class manages a lineage or coalescence tree
+ * \brief   puu_snapshot class declaration
+ * \details The puu_snapshot class holds the copy of a dead selection unit. A
+ *          snapshot can be shared by several nodes (e.g. along a clonal chain)
+ *          and is deleted with its copy when the last node releases it.
+ *          A snapshot is either a keyframe, holding a full copy, or a delta
+ *          relative to a base snapshot, materialized on demand by a
+ *          puu_delta_codec. The copy of a keyframe attached to a
+ *          puu_snapshot_store can be evicted to disk, and is loaded back on
+ *          demand.
  */
 template <typename selection_unit>
-class puu_tree
+class puu_snapshot
 {
 
 public:
@@ -626,41 +740,41 @@ public:
   /*----------------------------
    * CONSTRUCTORS
    *----------------------------*/
-  puu_tree( void );
-  puu_tree( const puu_tree& tree ) = delete;
-
-  /*----------------------------
-   * DESTRUCTORS
-   *----------------------------*/
-  ~puu_tree( void );
+  puu_snapshot( void ) = delete;
+  puu_snapshot( selection_unit* unit, size_t hash );
+  puu_snapshot( puu_snapshot* base, std::string& delta, puu_delta_codec<selection_unit>* codec, size_t hash );
+  puu_snapshot( const puu_snapshot& snapshot ) = delete;
 
   /*----------------------------
    * GETTERS
    *----------------------------*/
-  inline size_t                    get_number_of_nodes( void ) const;
-  inline puu_node<selection_unit>* get_node_by_identifier( unsigned long long int identifier );
-  inline puu_node<selection_unit>* get_node_by_selection_unit( selection_unit* unit );
-  inline puu_node<selection_unit>* get_first( void );
-  inline puu_node<selection_unit>* get_next( void );
-  inline void                      get_active_node_identifiers( std::vector<unsigned long long int>* active_node_identifiers );
-  inline puu_node<selection_unit>* get_common_ancestor( void );
-  inline double                    get_common_ancestor_age( void );
+  inline selection_unit*    get_unit( void );
+  inline size_t             get_hash( void ) const;
+  inline unsigned int       get_number_of_references( void ) const;
+  inline bool               is_keyframe( void ) const;
+  inline puu_snapshot*      get_base( void );
+  inline const std::string& get_delta( void ) const;
+  inline unsigned int       get_depth( void ) const;
+  inline selection_unit*    get_resident_unit( void );
+  inline bool               is_stored( void ) const;
+  inline size_t             get_offset( void ) const;
+  inline size_t             get_length( void ) const;
 
   /*----------------------------
    * SETTERS
    *----------------------------*/
-  puu_tree& operator=(const puu_tree&) = delete;
+  puu_snapshot& operator=(const puu_snapshot&) = delete;
+
+  inline void set_store( puu_snapshot_store<selection_unit>* store );
+  inline void set_extent( size_t offset, size_t length );
 
   /*----------------------------
    * PUBLIC METHODS
    *----------------------------*/
-  void add_root( selection_unit* unit );
-  void add_reproduction_event( selection_unit* parent, selection_unit* child, double time );
-  void inactivate( selection_unit* unit, bool copy_unit );
-  void update_as_lineage_tree( void );
-  void update_as_coalescence_tree( void );
-  void write_tree( std::string filename );
-  void write_newick_tree( std::string filename );
+  inline void retain( void );
+  inline void release( void );
+  inline void swap_in( selection_unit* unit );
+  inline void swap_out( void );
 
   /*----------------------------
    * PUBLIC ATTRIBUTES
@@ -668,24 +782,28 @@ public:
 
 protected:
 
+  /*----------------------------
+   * DESTRUCTORS
+   *----------------------------*/
+  ~puu_snapshot( void );
+
   /*----------------------------
    * PROTECTED METHODS
    *----------------------------*/
-  void prune( void );
-  void shorten( void );
-  void delete_node( unsigned long long int node_identifier );
-  void inOrderNewick( puu_node<selection_unit>* node, double parent_time, std::stringstream& output );
-  void tag_tree();
-  void untag_tree();
-  void tag_offspring( puu_node<selection_unit>* node, std::vector<puu_node<selection_unit>*>* tagged_nodes );
 
   /*----------------------------
    * PROTECTED ATTRIBUTES
    *----------------------------*/
-  unsigned long long int                                                                   _current_id; /*!< Current node id     */
-  std::unordered_map<unsigned long long int, puu_node<selection_unit>*>                    _node_map;   /*!< Tree nodes map      */
-  std::unordered_map<selection_unit*, puu_node<selection_unit>*>                           _unit_map;   /*!< Selection units map */
-  typename std::unordered_map<unsigned long long int, puu_node<selection_unit>*>::iterator _iterator;   /*!< Tree map iterator   */
+  selection_unit*                     _unit;       /*!< Copy of the selection unit (keyframes only)    */
+  size_t                              _hash;       /*!< Hash of the copy (0 if not shared)             */
+  unsigned int                        _references; /*!< Number of nodes and snapshots holding it       */
+  unsigned int                        _depth;      /*!< Number of deltas since the last keyframe       */
+  puu_snapshot*                       _base;       /*!< Base snapshot of a delta (NULL for keyframes)  */
+  std::string                         _delta;      /*!< Delta relative to the base snapshot            */
+  puu_delta_codec<selection_unit>*    _codec;      /*!< Codec materializing deltas                     */
+  puu_snapshot_store<selection_unit>* _store;      /*!< Store of the copy (NULL if not stored)         */
+  size_t                              _offset;     /*!< Position of the stored copy                    */
+  size_t                              _length;     /*!< Length of the stored copy                      */
 };
 
 /*----------------------------
@@ -693,592 +811,5737 @@ protected:
  *----------------------------*/
 
 /**
- * \brief    Get the number of nodes in the tree
- * \details  --
+ * \brief    Get the copy of the selection unit
+ * \details  The copy of a delta is materialized in the codec cache, and
+ *           remains valid until it is evicted. The copy of a stored keyframe
+ *           is loaded back if needed, and remains valid until it is evicted.
  * \param    void
- * \return   \e size_t
+ * \return   \e selection_unit*
  */
 template <typename selection_unit>
-inline size_t puu_tree<selection_unit>::get_number_of_nodes( void ) const
+inline selection_unit* puu_snapshot<selection_unit>::get_unit( void )
 {
-  return _node_map.size();
+  if (_base != NULL)
+  {
+    return _codec->materialize(this);
+  }
+  if (_store != NULL)
+  {
+    return _store->access(this);
+  }
+  return _unit;
 }
 
 /**
- * \brief    Get the node by its identifier
- * \details  Returns NULL if the node does not exist
- * \param    unsigned long long int identifier
- * \return   \e Node*
+ * \brief    Get the hash of the copy
+ * \details  --
+ * \param    void
+ * \return   \e size_t
  */
 template <typename selection_unit>
-inline puu_node<selection_unit>* puu_tree<selection_unit>::get_node_by_identifier( unsigned long long int identifier )
+inline size_t puu_snapshot<selection_unit>::get_hash( void ) const
 {
-  if (_node_map.find(identifier) != _node_map.end())
-  {
-    return _node_map[identifier];
+  return _hash;
+}
+
+/**
+ * \brief    Get the number of nodes holding the snapshot
+ * \details  --
+ * \param    void
+ * \return   \e unsigned int
+ */
+template <typename selection_unit>
+inline unsigned int puu_snapshot<selection_unit>::get_number_of_references( void ) const
+{
+  return _references;
+}
+
+/**
+ * \brief    Check if the snapshot holds a full copy
+ * \details  --
+ * \param    void
+ * \return   \e bool
+ */
+template <typename selection_unit>
+inline bool puu_snapshot<selection_unit>::is_keyframe( void ) const
+{
+  return (_base == NULL);
+}
+
+/**
+ * \brief    Get the base snapshot of a delta
+ * \details  Returns NULL for keyframes
+ * \param    void
+ * \return   \e puu_snapshot*
+ */
+template <typename selection_unit>
+inline puu_snapshot<selection_unit>* puu_snapshot<selection_unit>::get_base( void )
+{
+  return _base;
+}
+
+/**
+ * \brief    Get the delta relative to the base snapshot
+ * \details  --
+ * \param    void
+ * \return   \e const std::string&
+ */
+template <typename selection_unit>
+inline const std::string& puu_snapshot<selection_unit>::get_delta( void ) const
+{
+  return _delta;
+}
+
+/**
+ * \brief    Get the number of deltas since the last keyframe
+ * \details  --
+ * \param    void
+ * \return   \e unsigned int
+ */
+template <typename selection_unit>
+inline unsigned int puu_snapshot<selection_unit>::get_depth( void ) const
+{
+  return _depth;
+}
+
+/**
+ * \brief    Get the copy of the selection unit if it is in memory
+ * \details  Returns NULL for deltas and evicted keyframes
+ * \param    void
+ * \return   \e selection_unit*
+ */
+template <typename selection_unit>
+inline selection_unit* puu_snapshot<selection_unit>::get_resident_unit( void )
+{
+  return _unit;
+}
+
+/**
+ * \brief    Check if the copy is attached to a snapshot store
+ * \details  --
+ * \param    void
+ * \return   \e bool
+ */
+template <typename selection_unit>
+inline bool puu_snapshot<selection_unit>::is_stored( void ) const
+{
+  return (_store != NULL);
+}
+
+/**
+ * \brief    Get the position of the stored copy
+ * \details  --
+ * \param    void
+ * \return   \e size_t
+ */
+template <typename selection_unit>
+inline size_t puu_snapshot<selection_unit>::get_offset( void ) const
+{
+  return _offset;
+}
+
+/**
+ * \brief    Get the length of the stored copy
+ * \details  --
+ * \param    void
+ * \return   \e size_t
+ */
+template <typename selection_unit>
+inline size_t puu_snapshot<selection_unit>::get_length( void ) const
+{
+  return _length;
+}
+
+/*----------------------------
+ * SETTERS
+ *----------------------------*/
+
+/**
+ * \brief    Attach the snapshot to the store keeping its copy
+ * \details  The copy is written in the backing file when it is first evicted
+ * \param    puu_snapshot_store* store
+ * \return   \e void
+ */
+template <typename selection_unit>
+inline void puu_snapshot<selection_unit>::set_store( puu_snapshot_store<selection_unit>* store )
+{
+  assert(_base == NULL);
+  assert(_store == NULL);
+  _store = store;
+}
+
+/**
+ * \brief    Set the position of the copy written in the backing file
+ * \details  --
+ * \param    size_t offset
+ * \param    size_t length
+ * \return   \e void
+ */
+template <typename selection_unit>
+inline void puu_snapshot<selection_unit>::set_extent( size_t offset, size_t length )
+{
+  assert(_store != NULL);
+  _offset = offset;
+  _length = length;
+}
+
+/*----------------------------
+ * CONSTRUCTORS
+ *----------------------------*/
+
+/**
+ * \brief    Constructor
+ * \details  The snapshot takes the ownership of 'unit', and is created
+ *           without reference
+ * \param    selection_unit* unit
+ * \param    size_t hash
+ * \return   \e void
+ */
+template <typename selection_unit>
+puu_snapshot<selection_unit>::puu_snapshot( selection_unit* unit, size_t hash )
+{
+  assert(unit != NULL);
+  _unit       = unit;
+  _hash       = hash;
+  _references = 0;
+  _depth      = 0;
+  _base       = NULL;
+  _codec      = NULL;
+  _store      = NULL;
+  _offset     = 0;
+  _length     = 0;
+}
+
+/**
+ * \brief    Delta constructor
+ * \details  The delta is moved into the snapshot, which holds a reference to
+ *           its base
+ * \param    puu_snapshot* base
+ * \param    std::string& delta
+ * \param    puu_delta_codec* codec
+ * \param    size_t hash
+ * \return   \e void
+ */
+template <typename selection_unit>
+puu_snapshot<selection_unit>::puu_snapshot( puu_snapshot* base, std::string& delta, puu_delta_codec<selection_unit>* codec, size_t hash )
+{
+  assert(base != NULL);
+  assert(codec != NULL);
+  _unit       = NULL;
+  _hash       = hash;
+  _references = 0;
+  _depth      = base->get_depth()+1;
+  _base       = base;
+  _codec      = codec;
+  _store      = NULL;
+  _offset     = 0;
+  _length     = 0;
+  _delta.swap(delta);
+  _base->retain();
+}
+
+/*----------------------------
+ * DESTRUCTORS
+ *----------------------------*/
+
+/**
+ * \brief    Destructor
+ * \details  --
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+puu_snapshot<selection_unit>::~puu_snapshot( void )
+{
+  assert(_references == 0);
+  if (_base != NULL)
+  {
+    _codec->forget(this);
+    _base->release();
+    _base = NULL;
+  }
+  if (_store != NULL)
+  {
+    _store->forget(this);
+    _store = NULL;
+  }
+  delete _unit;
+  _unit = NULL;
+}
+
+/*----------------------------
+ * PUBLIC METHODS
+ *----------------------------*/
+
+/**
+ * \brief    Adds a reference to the snapshot
+ * \details  --
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+inline void puu_snapshot<selection_unit>::retain( void )
+{
+  _references++;
+}
+
+/**
+ * \brief    Removes a reference to the snapshot
+ * \details  The snapshot is deleted with the last reference
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+inline void puu_snapshot<selection_unit>::release( void )
+{
+  assert(_references > 0);
+  _references--;
+  if (_references == 0)
+  {
+    delete this;
+  }
+}
+
+/**
+ * \brief    Gives back the copy of an evicted keyframe
+ * \details  The snapshot takes the ownership of 'unit'
+ * \param    selection_unit* unit
+ * \return   \e void
+ */
+template <typename selection_unit>
+inline void puu_snapshot<selection_unit>::swap_in( selection_unit* unit )
+{
+  assert(_store != NULL);
+  assert(_unit == NULL);
+  _unit = unit;
+}
+
+/**
+ * \brief    Deletes the copy of a stored keyframe
+ * \details  The copy remains available from the store
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+inline void puu_snapshot<selection_unit>::swap_out( void )
+{
+  assert(_store != NULL);
+  delete _unit;
+  _unit = NULL;
+}
+
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+/* puu_delta_codec class declarations and definitions                         */
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+/**
+ * \brief   puu_delta_codec class declaration
+ * \details The puu_delta_codec class encodes snapshots as deltas relative to
+ *          their parental snapshot, with a keyframe every
+ *          'keyframe_interval' snapshots along a lineage. Deltas are built
+ *          and applied by user functions. Materialized deltas are kept in a
+ *          least-recently-used cache of 'cache_size' selection units.
+ */
+template <typename selection_unit>
+class puu_delta_codec
+{
+
+public:
+
+  /*----------------------------
+   * CONSTRUCTORS
+   *----------------------------*/
+  puu_delta_codec( void ) = delete;
+  puu_delta_codec( std::function<void(const selection_unit&, const selection_unit&, std::string&)> encoder, std::function<void(selection_unit&, const std::string&)> decoder, unsigned int keyframe_interval, size_t cache_size );
+  puu_delta_codec( const puu_delta_codec& codec ) = delete;
+
+  /*----------------------------
+   * DESTRUCTORS
+   *----------------------------*/
+  ~puu_delta_codec( void );
+
+  /*----------------------------
+   * GETTERS
+   *----------------------------*/
+  inline unsigned int get_keyframe_interval( void ) const;
+  inline size_t       get_cache_size( void ) const;
+  inline size_t       get_number_of_cached_units( void ) const;
+
+  /*----------------------------
+   * SETTERS
+   *----------------------------*/
+  puu_delta_codec& operator=(const puu_delta_codec&) = delete;
+
+  /*----------------------------
+   * PUBLIC METHODS
+   *----------------------------*/
+  puu_snapshot<selection_unit>* encode( puu_snapshot<selection_unit>* base, const selection_unit& unit, size_t hash );
+  selection_unit*               materialize( puu_snapshot<selection_unit>* snapshot );
+  void                          forget( puu_snapshot<selection_unit>* snapshot );
+
+  /*----------------------------
+   * PUBLIC ATTRIBUTES
+   *----------------------------*/
+
+protected:
+
+  /*----------------------------
+   * PROTECTED METHODS
+   *----------------------------*/
+
+  /*----------------------------
+   * PROTECTED ATTRIBUTES
+   *----------------------------*/
+  typedef std::list<puu_snapshot<selection_unit>*>                               lru_list;
+  typedef std::unordered_map<puu_snapshot<selection_unit>*,
+                             std::pair<selection_unit*, typename lru_list::iterator> > lru_map;
+
+  std::function<void(const selection_unit&, const selection_unit&, std::string&)> _encoder;           /*!< Builds the delta between two units         */
+  std::function<void(selection_unit&, const std::string&)>                        _decoder;           /*!< Applies a delta to a unit                  */
+  unsigned int                                                                    _keyframe_interval; /*!< Number of snapshots between keyframes      */
+  size_t                                                                          _cache_size;        /*!< Maximum number of materialized units       */
+  lru_list                                                                        _lru;               /*!< Cached snapshots, most recently used first */
+  lru_map                                                                         _cache;             /*!< Materialized units of cached snapshots     */
+};
+
+/*----------------------------
+ * GETTERS
+ *----------------------------*/
+
+/**
+ * \brief    Get the number of snapshots between keyframes
+ * \details  --
+ * \param    void
+ * \return   \e unsigned int
+ */
+template <typename selection_unit>
+inline unsigned int puu_delta_codec<selection_unit>::get_keyframe_interval( void ) const
+{
+  return _keyframe_interval;
+}
+
+/**
+ * \brief    Get the maximum number of materialized units
+ * \details  --
+ * \param    void
+ * \return   \e size_t
+ */
+template <typename selection_unit>
+inline size_t puu_delta_codec<selection_unit>::get_cache_size( void ) const
+{
+  return _cache_size;
+}
+
+/**
+ * \brief    Get the number of materialized units
+ * \details  --
+ * \param    void
+ * \return   \e size_t
+ */
+template <typename selection_unit>
+inline size_t puu_delta_codec<selection_unit>::get_number_of_cached_units( void ) const
+{
+  return _cache.size();
+}
+
+/*----------------------------
+ * CONSTRUCTORS
+ *----------------------------*/
+
+/**
+ * \brief    Constructor
+ * \details  encoder(base, unit, delta) writes in 'delta' what turns 'base' into
+ *           'unit', and decoder(unit, delta) applies it
+ * \param    std::function<void(const selection_unit&, const selection_unit&, std::string&)> encoder
+ * \param    std::function<void(selection_unit&, const std::string&)> decoder
+ * \param    unsigned int keyframe_interval
+ * \param    size_t cache_size
+ * \return   \e void
+ */
+template <typename selection_unit>
+puu_delta_codec<selection_unit>::puu_delta_codec( std::function<void(const selection_unit&, const selection_unit&, std::string&)> encoder, std::function<void(selection_unit&, const std::string&)> decoder, unsigned int keyframe_interval, size_t cache_size )
+{
+  assert(keyframe_interval > 0);
+  assert(cache_size > 0);
+  _encoder           = encoder;
+  _decoder           = decoder;
+  _keyframe_interval = keyframe_interval;
+  _cache_size        = cache_size;
+  _lru.clear();
+  _cache.clear();
+}
+
+/*----------------------------
+ * DESTRUCTORS
+ *----------------------------*/
+
+/**
+ * \brief    Destructor
+ * \details  --
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+puu_delta_codec<selection_unit>::~puu_delta_codec( void )
+{
+  for (typename lru_map::iterator it = _cache.begin(); it != _cache.end(); ++it)
+  {
+    delete it->second.first;
+  }
+  _cache.clear();
+  _lru.clear();
+}
+
+/*----------------------------
+ * PUBLIC METHODS
+ *----------------------------*/
+
+/**
+ * \brief    Creates the snapshot of a unit, given its parental snapshot
+ * \details  A keyframe is created if there is no base, or if the base is the
+ *           last delta before the next keyframe
+ * \param    puu_snapshot* base
+ * \param    const selection_unit& unit
+ * \param    size_t hash
+ * \return   \e puu_snapshot*
+ */
+template <typename selection_unit>
+puu_snapshot<selection_unit>* puu_delta_codec<selection_unit>::encode( puu_snapshot<selection_unit>* base, const selection_unit& unit, size_t hash )
+{
+  if (base == NULL || base->get_depth()+1 >= _keyframe_interval)
+  {
+    return new puu_snapshot<selection_unit>(new selection_unit(unit), hash);
+  }
+  std::string delta;
+  _encoder(*base->get_unit(), unit, delta);
+  return new puu_snapshot<selection_unit>(base, delta, this, hash);
+}
+
+/**
+ * \brief    Materializes the selection unit of a delta snapshot
+ * \details  Deltas are applied to a copy of the closest keyframe or cached
+ *           ancestor. The unit is then cached, and the least recently used
+ *           unit is evicted if the cache is full.
+ * \param    puu_snapshot* snapshot
+ * \return   \e selection_unit*
+ */
+template <typename selection_unit>
+selection_unit* puu_delta_codec<selection_unit>::materialize( puu_snapshot<selection_unit>* snapshot )
+{
+  assert(!snapshot->is_keyframe());
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 1) Look for the unit in the cache */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  typename lru_map::iterator it = _cache.find(snapshot);
+  if (it != _cache.end())
+  {
+    _lru.splice(_lru.begin(), _lru, it->second.second);
+    return it->second.first;
+  }
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 2) Find the closest full copy     */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  std::vector<puu_snapshot<selection_unit>*> chain;
+  puu_snapshot<selection_unit>*              ancestor = snapshot;
+  selection_unit*                            origin   = NULL;
+  while (origin == NULL)
+  {
+    chain.push_back(ancestor);
+    ancestor = ancestor->get_base();
+    if (ancestor->is_keyframe())
+    {
+      origin = ancestor->get_unit();
+    }
+    else
+    {
+      it = _cache.find(ancestor);
+      if (it != _cache.end())
+      {
+        origin = it->second.first;
+      }
+    }
+  }
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 3) Apply deltas                   */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  selection_unit* unit = new selection_unit(*origin);
+  for (size_t i = chain.size(); i > 0; i--)
+  {
+    _decoder(*unit, chain[i-1]->get_delta());
+  }
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 4) Cache the unit                 */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  _lru.push_front(snapshot);
+  _cache[snapshot] = std::make_pair(unit, _lru.begin());
+  while (_cache.size() > _cache_size)
+  {
+    it = _cache.find(_lru.back());
+    delete it->second.first;
+    _cache.erase(it);
+    _lru.pop_back();
+  }
+  return unit;
+}
+
+/**
+ * \brief    Removes a snapshot from the cache
+ * \details  Called when a delta snapshot is deleted
+ * \param    puu_snapshot* snapshot
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_delta_codec<selection_unit>::forget( puu_snapshot<selection_unit>* snapshot )
+{
+  typename lru_map::iterator it = _cache.find(snapshot);
+  if (it != _cache.end())
+  {
+    delete it->second.first;
+    _lru.erase(it->second.second);
+    _cache.erase(it);
+  }
+}
+
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+/* puu_snapshot_store class declarations and definitions                      */
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+/**
+ * \brief   puu_snapshot_store class declaration
+ * \details The puu_snapshot_store class keeps the copies of keyframe
+ *          snapshots within a memory budget. The least recently used copies
+ *          are deleted when the budget is exceeded, and deserialized back on
+ *          demand. Snapshots being immutable, each copy is serialized once
+ *          in a backing file, when it is first evicted: copies deleted while
+ *          still resident are never written. The extents of deleted copies
+ *          are merged and reused by the next writes. A resident copy costs
+ *          sizeof(selection_unit) plus its serialized length, the mean
+ *          serialized length being charged until the copy is written. Units
+ *          rebuilt from deltas by the puu_delta_codec cache are not counted.
+ *          If PUUTOOLS_USE_MMAP is defined before including puutools.h, on
+ *          POSIX systems, the backing file is mapped in memory. Otherwise,
+ *          it is read and written as a stream.
+ */
+template <typename selection_unit>
+class puu_snapshot_store
+{
+
+public:
+
+  /*----------------------------
+   * CONSTRUCTORS
+   *----------------------------*/
+  puu_snapshot_store( void ) = delete;
+  puu_snapshot_store( std::string filename, size_t memory_budget, std::function<void(const selection_unit&, std::ostream&)> serializer, std::function<selection_unit*(std::istream&)> deserializer );
+  puu_snapshot_store( const puu_snapshot_store& store ) = delete;
+
+  /*----------------------------
+   * DESTRUCTORS
+   *----------------------------*/
+  ~puu_snapshot_store( void );
+
+  /*----------------------------
+   * GETTERS
+   *----------------------------*/
+  inline size_t get_memory_budget( void ) const;
+  inline size_t get_resident_size( void ) const;
+  inline size_t get_number_of_resident_units( void ) const;
+  inline size_t get_file_size( void ) const;
+  inline size_t get_free_size( void ) const;
+
+  /*----------------------------
+   * SETTERS
+   *----------------------------*/
+  puu_snapshot_store& operator=(const puu_snapshot_store&) = delete;
+
+  /*----------------------------
+   * PUBLIC METHODS
+   *----------------------------*/
+  void            store( puu_snapshot<selection_unit>* snapshot );
+  selection_unit* access( puu_snapshot<selection_unit>* snapshot );
+  void            forget( puu_snapshot<selection_unit>* snapshot );
+
+  /*----------------------------
+   * PUBLIC ATTRIBUTES
+   *----------------------------*/
+
+protected:
+
+  /*----------------------------
+   * PROTECTED METHODS
+   *----------------------------*/
+#ifdef PUUTOOLS_MMAP
+  void   map_file( size_t capacity );
+#endif
+  size_t serialize( puu_snapshot<selection_unit>* snapshot );
+  void   write( puu_snapshot<selection_unit>* snapshot );
+  size_t allocate_extent( size_t length );
+  void   release_extent( size_t offset, size_t length );
+  void   remove_free_extent( size_t offset, size_t length );
+  void   evict( void );
+
+  /*----------------------------
+   * PROTECTED ATTRIBUTES
+   *----------------------------*/
+  typedef std::list<puu_snapshot<selection_unit>*> lru_list;
+
+  /**
+   * \brief   Position of a resident copy in the LRU list
+   */
+  struct resident_copy
+  {
+    typename lru_list::iterator position; /*!< Position in the LRU list           */
+    bool                        written;  /*!< Is the copy in the backing file?  */
+  };
+
+  typedef std::unordered_map<puu_snapshot<selection_unit>*, resident_copy> lru_map;
+
+  /**
+   * \brief   Input buffer reading a stored copy in place
+   */
+  struct memory_buffer : public std::streambuf
+  {
+    memory_buffer( char* begin, size_t length ) { setg(begin, begin, begin+length); }
+  };
+
+  std::function<void(const selection_unit&, std::ostream&)> _serializer;       /*!< Writes a copy in the backing file         */
+  std::function<selection_unit*(std::istream&)>             _deserializer;     /*!< Reads a copy from the backing file        */
+  size_t                                                    _memory_budget;    /*!< Maximum size of resident copies           */
+  size_t                                                    _written_size;     /*!< Size of resident copies already written   */
+  size_t                                                    _unwritten;        /*!< Number of resident copies not yet written */
+  size_t                                                    _serialized_size;  /*!< Total length of serialized copies         */
+  size_t                                                    _serialized;       /*!< Number of serialized copies               */
+#ifdef PUUTOOLS_MMAP
+  int                                                       _fd;               /*!< Descriptor of the backing file            */
+  char*                                                     _data;             /*!< Mapping of the backing file               */
+  size_t                                                    _capacity;         /*!< Size of the mapping                       */
+#else
+  std::string                                               _filename;         /*!< Name of the backing file                  */
+  std::fstream                                              _file;             /*!< Backing file                              */
+  std::string                                               _read_buffer;      /*!< Copy read from the backing file           */
+#endif
+  size_t                                                    _size;             /*!< End of the last extent in use             */
+  size_t                                                    _free_size;        /*!< Number of free bytes below '_size'        */
+  std::map<size_t, size_t>                                  _free_offsets;     /*!< Free extents by offset                    */
+  std::set<std::pair<size_t, size_t> >                      _free_lengths;     /*!< Free extents by length and offset         */
+  std::ostringstream                                        _stream;           /*!< Serialization buffer                      */
+  lru_list                                                  _lru;              /*!< Resident copies, most recent first        */
+  lru_map                                                   _resident;         /*!< Positions of resident copies              */
+};
+
+/*----------------------------
+ * GETTERS
+ *----------------------------*/
+
+/**
+ * \brief    Get the memory budget
+ * \details  --
+ * \param    void
+ * \return   \e size_t
+ */
+template <typename selection_unit>
+inline size_t puu_snapshot_store<selection_unit>::get_memory_budget( void ) const
+{
+  return _memory_budget;
+}
+
+/**
+ * \brief    Get the size of resident copies
+ * \details  Copies not yet written are charged the mean serialized length
+ * \param    void
+ * \return   \e size_t
+ */
+template <typename selection_unit>
+inline size_t puu_snapshot_store<selection_unit>::get_resident_size( void ) const
+{
+  size_t mean_length = (_serialized > 0 ? _serialized_size/_serialized : 0);
+  return _written_size+_unwritten*(sizeof(selection_unit)+mean_length);
+}
+
+/**
+ * \brief    Get the number of resident copies
+ * \details  --
+ * \param    void
+ * \return   \e size_t
+ */
+template <typename selection_unit>
+inline size_t puu_snapshot_store<selection_unit>::get_number_of_resident_units( void ) const
+{
+  return _resident.size();
+}
+
+/**
+ * \brief    Get the number of bytes used in the backing file
+ * \details  Free extents below the last one in use are included (see
+ *           get_free_size())
+ * \param    void
+ * \return   \e size_t
+ */
+template <typename selection_unit>
+inline size_t puu_snapshot_store<selection_unit>::get_file_size( void ) const
+{
+  return _size;
+}
+
+/**
+ * \brief    Get the number of free bytes in the backing file
+ * \details  --
+ * \param    void
+ * \return   \e size_t
+ */
+template <typename selection_unit>
+inline size_t puu_snapshot_store<selection_unit>::get_free_size( void ) const
+{
+  return _free_size;
+}
+
+/*----------------------------
+ * CONSTRUCTORS
+ *----------------------------*/
+
+/**
+ * \brief    Constructor
+ * \details  The backing file is removed with the store (on POSIX systems, it
+ *           is unlinked as soon as it is created)
+ * \param    std::string filename
+ * \param    size_t memory_budget
+ * \param    std::function<void(const selection_unit&, std::ostream&)> serializer
+ * \param    std::function<selection_unit*(std::istream&)> deserializer
+ * \return   \e void
+ */
+template <typename selection_unit>
+puu_snapshot_store<selection_unit>::puu_snapshot_store( std::string filename, size_t memory_budget, std::function<void(const selection_unit&, std::ostream&)> serializer, std::function<selection_unit*(std::istream&)> deserializer )
+{
+  _serializer      = serializer;
+  _deserializer    = deserializer;
+  _memory_budget   = memory_budget;
+  _written_size    = 0;
+  _unwritten       = 0;
+  _serialized_size = 0;
+  _serialized      = 0;
+  _size            = 0;
+  _free_size       = 0;
+#ifdef PUUTOOLS_MMAP
+  _data            = NULL;
+  _capacity        = 0;
+  _fd              = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (_fd < 0)
+  {
+    printf("Error in puu_snapshot_store::puu_snapshot_store(): cannot create file %s. Exit.\n", filename.c_str());
+    exit(EXIT_FAILURE);
+  }
+  unlink(filename.c_str());
+#else
+  _filename = filename;
+  _file.open(filename.c_str(), std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+  if (!_file)
+  {
+    printf("Error in puu_snapshot_store::puu_snapshot_store(): cannot create file %s. Exit.\n", filename.c_str());
+    exit(EXIT_FAILURE);
+  }
+#endif
+  _free_offsets.clear();
+  _free_lengths.clear();
+  _lru.clear();
+  _resident.clear();
+}
+
+/*----------------------------
+ * DESTRUCTORS
+ *----------------------------*/
+
+/**
+ * \brief    Destructor
+ * \details  Stored snapshots must have been deleted
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+puu_snapshot_store<selection_unit>::~puu_snapshot_store( void )
+{
+  assert(_resident.empty());
+#ifdef PUUTOOLS_MMAP
+  if (_data != NULL)
+  {
+    munmap(_data, _capacity);
+    _data = NULL;
+  }
+  close(_fd);
+  _fd = -1;
+#else
+  _file.close();
+  std::remove(_filename.c_str());
+#endif
+}
+
+/*----------------------------
+ * PUBLIC METHODS
+ *----------------------------*/
+
+/**
+ * \brief    Attaches the copy of a keyframe to the store
+ * \details  The copy stays in memory, and is only written in the backing file
+ *           when it is first evicted. The first copy is serialized once to
+ *           estimate the resident size. Deltas and snapshots already stored
+ *           are ignored.
+ * \param    puu_snapshot* snapshot
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_snapshot_store<selection_unit>::store( puu_snapshot<selection_unit>* snapshot )
+{
+  if (!snapshot->is_keyframe() || snapshot->is_stored())
+  {
+    return;
+  }
+  if (_serialized == 0)
+  {
+    serialize(snapshot);
+  }
+  snapshot->set_store(this);
+  _lru.push_front(snapshot);
+  resident_copy& copy = _resident[snapshot];
+  copy.position       = _lru.begin();
+  copy.written        = false;
+  _unwritten++;
+  evict();
+}
+
+/**
+ * \brief    Get the copy of a stored keyframe
+ * \details  An evicted copy is deserialized back. The copy becomes the most
+ *           recently used one, and is never evicted before another one is
+ *           accessed.
+ * \param    puu_snapshot* snapshot
+ * \return   \e selection_unit*
+ */
+template <typename selection_unit>
+selection_unit* puu_snapshot_store<selection_unit>::access( puu_snapshot<selection_unit>* snapshot )
+{
+  typename lru_map::iterator it = _resident.find(snapshot);
+  if (it != _resident.end())
+  {
+    _lru.splice(_lru.begin(), _lru, it->second.position);
+    return snapshot->get_resident_unit();
+  }
+#ifdef PUUTOOLS_MMAP
+  memory_buffer   buffer(_data+snapshot->get_offset(), snapshot->get_length());
+#else
+  _read_buffer.resize(snapshot->get_length());
+  _file.seekg((std::streamoff)snapshot->get_offset());
+  _file.read(&_read_buffer[0], (std::streamsize)snapshot->get_length());
+  memory_buffer   buffer(&_read_buffer[0], snapshot->get_length());
+#endif
+  std::istream    stream(&buffer);
+  selection_unit* unit = _deserializer(stream);
+  if (unit == NULL)
+  {
+    printf("Error in puu_snapshot_store::access(): cannot read a stored selection unit. Exit.\n");
+    exit(EXIT_FAILURE);
+  }
+  snapshot->swap_in(unit);
+  _lru.push_front(snapshot);
+  resident_copy& copy = _resident[snapshot];
+  copy.position       = _lru.begin();
+  copy.written        = true;
+  _written_size      += sizeof(selection_unit)+snapshot->get_length();
+  evict();
+  return unit;
+}
+
+/**
+ * \brief    Removes a snapshot from the store
+ * \details  Called when a stored snapshot is deleted. The extent of its copy
+ *           in the backing file, if it was written, is freed.
+ * \param    puu_snapshot* snapshot
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_snapshot_store<selection_unit>::forget( puu_snapshot<selection_unit>* snapshot )
+{
+  bool written = true;
+  typename lru_map::iterator it = _resident.find(snapshot);
+  if (it != _resident.end())
+  {
+    written = it->second.written;
+    _lru.erase(it->second.position);
+    _resident.erase(it);
+    if (written)
+    {
+      _written_size -= sizeof(selection_unit)+snapshot->get_length();
+    }
+    else
+    {
+      _unwritten--;
+    }
+  }
+  if (written)
+  {
+    release_extent(snapshot->get_offset(), snapshot->get_length());
+  }
+}
+
+/*----------------------------
+ * PROTECTED METHODS
+ *----------------------------*/
+
+#ifdef PUUTOOLS_MMAP
+/**
+ * \brief    Grows the backing file and maps it again
+ * \details  --
+ * \param    size_t capacity
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_snapshot_store<selection_unit>::map_file( size_t capacity )
+{
+  if (_data != NULL)
+  {
+    munmap(_data, _capacity);
+    _data = NULL;
+  }
+  void* data = MAP_FAILED;
+  if (ftruncate(_fd, (off_t)capacity) == 0)
+  {
+    data = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+  }
+  if (data == MAP_FAILED)
+  {
+    printf("Error in puu_snapshot_store::map_file(): cannot map %zu bytes. Exit.\n", capacity);
+    exit(EXIT_FAILURE);
+  }
+  _data     = (char*)data;
+  _capacity = capacity;
+}
+#endif
+
+/**
+ * \brief    Serializes the copy of a resident keyframe in the buffer
+ * \details  The length is added to the mean serialized length
+ * \param    puu_snapshot* snapshot
+ * \return   \e size_t
+ */
+template <typename selection_unit>
+size_t puu_snapshot_store<selection_unit>::serialize( puu_snapshot<selection_unit>* snapshot )
+{
+  _stream.str(std::string());
+  _stream.clear();
+  _serializer(*snapshot->get_resident_unit(), _stream);
+  size_t length     = (size_t)_stream.tellp();
+  _serialized_size += length;
+  _serialized++;
+  return length;
+}
+
+/**
+ * \brief    Writes the copy of a resident keyframe in the backing file
+ * \details  --
+ * \param    puu_snapshot* snapshot
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_snapshot_store<selection_unit>::write( puu_snapshot<selection_unit>* snapshot )
+{
+  serialize(snapshot);
+  const std::string& bytes  = _stream.str();
+  size_t             offset = allocate_extent(bytes.size());
+#ifdef PUUTOOLS_MMAP
+  memcpy(_data+offset, bytes.data(), bytes.size());
+#else
+  _file.seekp((std::streamoff)offset);
+  _file.write(bytes.data(), (std::streamsize)bytes.size());
+#endif
+  snapshot->set_extent(offset, bytes.size());
+}
+
+/**
+ * \brief    Finds an extent of 'length' bytes in the backing file
+ * \details  The smallest free extent large enough is used, and the rest of it
+ *           is kept free. Otherwise, the extent is appended at the end.
+ * \param    size_t length
+ * \return   \e size_t
+ */
+template <typename selection_unit>
+size_t puu_snapshot_store<selection_unit>::allocate_extent( size_t length )
+{
+  if (length == 0)
+  {
+    return 0;
+  }
+  std::set<std::pair<size_t, size_t> >::iterator it = _free_lengths.lower_bound(std::make_pair(length, (size_t)0));
+  if (it != _free_lengths.end())
+  {
+    size_t offset      = it->second;
+    size_t free_length = it->first;
+    remove_free_extent(offset, free_length);
+    if (free_length > length)
+    {
+      _free_offsets[offset+length] = free_length-length;
+      _free_lengths.insert(std::make_pair(free_length-length, offset+length));
+      _free_size += free_length-length;
+    }
+    return offset;
+  }
+  size_t offset = _size;
+#ifdef PUUTOOLS_MMAP
+  if (_size+length > _capacity)
+  {
+    map_file(std::max(std::max(_size+length, 2*_capacity), (size_t)1048576));
+  }
+#endif
+  _size += length;
+  return offset;
+}
+
+/**
+ * \brief    Frees an extent of the backing file
+ * \details  The extent is merged with the free extents around it. An extent
+ *           reaching the end of the file shrinks it instead.
+ * \param    size_t offset
+ * \param    size_t length
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_snapshot_store<selection_unit>::release_extent( size_t offset, size_t length )
+{
+  if (length == 0)
+  {
+    return;
+  }
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 1) Merge with the next free extent        */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  std::map<size_t, size_t>::iterator next = _free_offsets.find(offset+length);
+  if (next != _free_offsets.end())
+  {
+    size_t next_length = next->second;
+    remove_free_extent(offset+length, next_length);
+    length += next_length;
+  }
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 2) Merge with the previous free extent    */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  std::map<size_t, size_t>::iterator previous = _free_offsets.lower_bound(offset);
+  if (previous != _free_offsets.begin())
+  {
+    --previous;
+    if (previous->first+previous->second == offset)
+    {
+      size_t previous_offset = previous->first;
+      size_t previous_length = previous->second;
+      remove_free_extent(previous_offset, previous_length);
+      offset  = previous_offset;
+      length += previous_length;
+    }
+  }
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 3) Shrink the file or keep the extent     */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  if (offset+length == _size)
+  {
+    _size = offset;
+  }
+  else
+  {
+    _free_offsets[offset] = length;
+    _free_lengths.insert(std::make_pair(length, offset));
+    _free_size += length;
+  }
+}
+
+/**
+ * \brief    Removes an extent from the free extents
+ * \details  --
+ * \param    size_t offset
+ * \param    size_t length
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_snapshot_store<selection_unit>::remove_free_extent( size_t offset, size_t length )
+{
+  _free_offsets.erase(offset);
+  _free_lengths.erase(std::make_pair(length, offset));
+  _free_size -= length;
+}
+
+/**
+ * \brief    Evicts the least recently used copies above the memory budget
+ * \details  A copy evicted for the first time is written in the backing file.
+ *           The most recently used copy is kept.
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_snapshot_store<selection_unit>::evict( void )
+{
+  while (get_resident_size() > _memory_budget && _lru.size() > 1)
+  {
+    puu_snapshot<selection_unit>* snapshot = _lru.back();
+    typename lru_map::iterator    it       = _resident.find(snapshot);
+    if (it->second.written)
+    {
+      _written_size -= sizeof(selection_unit)+snapshot->get_length();
+    }
+    else
+    {
+      write(snapshot);
+      _unwritten--;
+    }
+    _lru.pop_back();
+    _resident.erase(it);
+    snapshot->swap_out();
+  }
+}
+
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+/* puu_node class declarations and definitions                                */
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+/**
+ * \brief   puu_node class declaration
+ * \details The puu_node class manages a lineage or coalescence node
+ */
+template <typename selection_unit>
+class puu_node
+{
+
+public:
+
+  /*----------------------------
+   * CONSTRUCTORS
+   *----------------------------*/
+  puu_node( void ) = delete;
+  puu_node( unsigned long long int identifier );
+  puu_node( unsigned long long int identifier, double time, selection_unit* unit );
+  puu_node( const puu_node& node ) = delete;
+
+  /*----------------------------
+   * DESTRUCTORS
+   *----------------------------*/
+  ~puu_node( void );
+
+  /*----------------------------
+   * GETTERS
+   *----------------------------*/
+  inline unsigned long long int get_identifier( void ) const;
+  inline size_t                 get_position( void ) const;
+  inline size_t                 get_slot( void ) const;
+  inline size_t                 get_child_index( void ) const;
+  inline double                 get_insertion_time( void ) const;
+  inline selection_unit*        get_selection_unit( void );
+  inline puu_snapshot<selection_unit>* get_snapshot( void );
+  inline puu_node*              get_previous( void );
+  inline puu_node*              get_parent( void );
+  inline puu_node*              get_child( size_t pos );
+  inline size_t                 get_number_of_children( void ) const;
+  inline puu_node_class         get_node_class( void ) const;
+  inline bool                   is_master_root( void ) const;
+  inline bool                   is_root( void ) const;
+  inline bool                   is_normal( void ) const;
+  inline bool                   is_ancestor( unsigned long long int ancestor_id ) const;
+  inline bool                   is_active( void ) const;
+  inline bool                   is_tagged( void ) const;
+
+  /*----------------------------
+   * SETTERS
+   *----------------------------*/
+  puu_node& operator=(const puu_node&) = delete;
+
+  inline void set_position( size_t position );
+  inline void set_slot( size_t slot );
+  inline void set_parent( puu_node* node );
+  inline void as_root( void );
+  inline void as_normal( void );
+  inline void inactivate( bool copy );
+  inline void inactivate_with_snapshot( puu_snapshot<selection_unit>* snapshot );
+  inline void restore( double time, selection_unit* unit, puu_snapshot<selection_unit>* snapshot );
+  inline void tag( void );
+  inline void untag( void );
+
+  /*----------------------------
+   * PUBLIC METHODS
+   *----------------------------*/
+  void add_child( puu_node* node );
+  void remove_child( puu_node* node );
+  void replace_by_grandchildren( puu_node* child_to_remove );
+  void tag_lineage( void );
+  void tag_lineage_concurrently( void );
+  void untag_lineage( void );
+
+  /*----------------------------
+   * PUBLIC ATTRIBUTES
+   *----------------------------*/
+
+protected:
+
+  /*----------------------------
+   * PROTECTED METHODS
+   *----------------------------*/
+
+  /*----------------------------
+   * PROTECTED ATTRIBUTES
+   *----------------------------*/
+  unsigned long long int         _identifier;     /*!< Node identifier                                   */
+  puu_node*                      _parent;         /*!< Parental node                                     */
+  puu_small_vector<puu_node*, 2> _children;       /*!< Node's children (the first two are stored inline) */
+  unsigned int                   _position;       /*!< Position of the node in the tree storage          */
+  unsigned int                   _slot;           /*!< Slot of the node in the node pool                 */
+  unsigned int                   _child_index;    /*!< Position of the node in its parent's children     */
+  unsigned char                  _node_class;     /*!< Node class (master root, root or normal)          */
+  bool                           _active;         /*!< Indicates if the node is active                   */
+  std::atomic<bool>              _tagged;         /*!< Indicates if the node is tagged                   */
+  double                         _insertion_time; /*!< Node's insertion time                             */
+  union
+  {
+    selection_unit*               _selection_unit; /*!< Attached selection unit, while active             */
+    puu_snapshot<selection_unit>* _snapshot;       /*!< Copy of the selection unit, once inactivated      */
+  };
+};
+
+/*----------------------------
+ * GETTERS
+ *----------------------------*/
+
+/**
+ * \brief    Get node's identifier
+ * \details  --
+ * \param    void
+ * \return   \e unsigned long long int
+ */
+template <typename selection_unit>
+inline unsigned long long int puu_node<selection_unit>::get_identifier( void ) const
+{
+  return _identifier;
+}
+
+/**
+ * \brief    Get node's position in the tree storage
+ * \details  --
+ * \param    void
+ * \return   \e size_t
+ */
+template <typename selection_unit>
+inline size_t puu_node<selection_unit>::get_position( void ) const
+{
+  return _position;
+}
+
+/**
+ * \brief    Get node's slot in the node pool
+ * \details  --
+ * \param    void
+ * \return   \e size_t
+ */
+template <typename selection_unit>
+inline size_t puu_node<selection_unit>::get_slot( void ) const
+{
+  return _slot;
+}
+
+/**
+ * \brief    Get node's position among the children of its parent
+ * \details  --
+ * \param    void
+ * \return   \e size_t
+ */
+template <typename selection_unit>
+inline size_t puu_node<selection_unit>::get_child_index( void ) const
+{
+  return _child_index;
+}
+
+/**
+ * \brief    Get node's insertion time
+ * \details  --
+ * \param    void
+ * \return   \e double
+ */
+template <typename selection_unit>
+inline double puu_node<selection_unit>::get_insertion_time( void ) const
+{
+  return _insertion_time;
+}
+
+/**
+ * \brief    Get the selection unit
+ * \details  Returns the copy of the selection unit for an inactive node (NULL
+ *           if it has not been copied). With delta snapshots, the copy of a
+ *           delta is rebuilt in a cache of the last 'cache_size' rebuilt
+ *           units, which owns it: the pointer becomes invalid after later
+ *           calls (with a cache size of 1, the next call on another node
+ *           already invalidates it). With a memory budget, the copy of a
+ *           stored snapshot remains valid until it is evicted again, i.e.
+ *           until other copies are read back. Do not keep the pointer.
+ * \param    void
+ * \return   \e selection_unit*
+ */
+template <typename selection_unit>
+inline selection_unit* puu_node<selection_unit>::get_selection_unit( void )
+{
+  if (_active)
+  {
+    return _selection_unit;
+  }
+  return (_snapshot != NULL ? _snapshot->get_unit() : NULL);
+}
+
+/**
+ * \brief    Get the snapshot of the selection unit
+ * \details  Returns NULL for active nodes and nodes inactivated without copy
+ * \param    void
+ * \return   \e puu_snapshot*
+ */
+template <typename selection_unit>
+inline puu_snapshot<selection_unit>* puu_node<selection_unit>::get_snapshot( void )
+{
+  return (_active ? NULL : _snapshot);
+}
+
+/**
+ * \brief    Get the previous node
+ * \details  --
+ * \param    void
+ * \return   \e puu_node*
+ */
+template <typename selection_unit>
+inline puu_node<selection_unit>* puu_node<selection_unit>::get_previous( void )
+{
+  return _parent;
+}
+
+/**
+ * \brief    Get the parental node
+ * \details  Returns also NULL if the parent is the master root
+ * \param    void
+ * \return   \e puu_node*
+ */
+template <typename selection_unit>
+inline puu_node<selection_unit>* puu_node<selection_unit>::get_parent( void )
+{
+  if (_parent != NULL && _parent->is_master_root())
+  {
+    return NULL;
+  }
+  return _parent;
+}
+
+/**
+ * \brief    Get the child at position 'pos'
+ * \details  --
+ * \param    void
+ * \return   \e puu_node*
+ */
+template <typename selection_unit>
+inline puu_node<selection_unit>* puu_node<selection_unit>::get_child( size_t pos )
+{
+  assert(pos < _children.size());
+  return _children[pos];
+}
+
+/**
+ * \brief    Get the number of children
+ * \details  --
+ * \param    void
+ * \return   \e puu_node*
+ */
+template <typename selection_unit>
+inline size_t puu_node<selection_unit>::get_number_of_children( void ) const
+{
+  return _children.size();
+}
+
+/**
+ * \brief    Get the node class
+ * \details  --
+ * \param    void
+ * \return   \e puu_node_class
+ */
+template <typename selection_unit>
+inline puu_node_class puu_node<selection_unit>::get_node_class( void ) const
+{
+  return (puu_node_class)_node_class;
+}
+
+/**
+ * \brief    Check if the node is the master root
+ * \details  --
+ * \param    void
+ * \return   \e bool
+ */
+template <typename selection_unit>
+inline bool puu_node<selection_unit>::is_master_root( void ) const
+{
+  return (_node_class == MASTER_ROOT);
+}
+
+/**
+ * \brief    Check if the node is a root
+ * \details  --
+ * \param    void
+ * \return   \e bool
+ */
+template <typename selection_unit>
+inline bool puu_node<selection_unit>::is_root( void ) const
+{
+  return (_node_class == ROOT);
+}
+
+/**
+ * \brief    Check if the node is normal
+ * \details  --
+ * \param    void
+ * \return   \e bool
+ */
+template <typename selection_unit>
+inline bool puu_node<selection_unit>::is_normal( void ) const
+{
+  return (_node_class == NORMAL);
+}
+
+/**
+ * \brief    Check if the given identifier is an ancestor
+ * \details  Walks the lineage up to the master root (see
+ *           puu_tree::is_ancestor() for constant time queries)
+ * \param    unsigned long long int ancestor_id
+ * \return   \e bool
+ */
+template <typename selection_unit>
+inline bool puu_node<selection_unit>::is_ancestor( unsigned long long int ancestor_id ) const
+{
+  const puu_node* node = _parent;
+  while (node != NULL)
+  {
+    if (node->get_identifier() == ancestor_id)
+    {
+      return true;
+    }
+    node = node->_parent;
+  }
+  return false;
+}
+
+/**
+ * \brief    Check if the node is active or inactive
+ * \details  --
+ * \param    void
+ * \return   \e bool
+ */
+template <typename selection_unit>
+inline bool puu_node<selection_unit>::is_active( void ) const
+{
+  return _active;
+}
+
+/**
+ * \brief    Check if the node is tagged or not
+ * \details  --
+ * \param    void
+ * \return   \e bool
+ */
+template <typename selection_unit>
+inline bool puu_node<selection_unit>::is_tagged( void ) const
+{
+  return _tagged.load(std::memory_order_relaxed);
+}
+
+/*----------------------------
+ * SETTERS
+ *----------------------------*/
+
+/**
+ * \brief    Set node's position in the tree storage
+ * \details  --
+ * \param    size_t position
+ * \return   \e void
+ */
+template <typename selection_unit>
+inline void puu_node<selection_unit>::set_position( size_t position )
+{
+  assert(position <= UINT_MAX);
+  _position = (unsigned int)position;
+}
+
+/**
+ * \brief    Set node's slot in the node pool
+ * \details  --
+ * \param    size_t slot
+ * \return   \e void
+ */
+template <typename selection_unit>
+inline void puu_node<selection_unit>::set_slot( size_t slot )
+{
+  assert(slot <= UINT_MAX);
+  _slot = (unsigned int)slot;
+}
+
+/**
+ * \brief    Add a parent
+ * \details  --
+ * \param    puu_node* node
+ * \return   \e void
+ */
+template <typename selection_unit>
+inline void puu_node<selection_unit>::set_parent( puu_node* node )
+{
+  _parent = node;
+}
+
+/**
+ * \brief    Set the node class as root
+ * \details  --
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+inline void puu_node<selection_unit>::as_root( void )
+{
+  _node_class = ROOT;
+}
+
+/**
+ * \brief    Set the node class as normal
+ * \details  --
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+inline void puu_node<selection_unit>::as_normal( void )
+{
+  _node_class = NORMAL;
+}
+
+/** @
+ * \brief    Inactivate the node
+ * \details  --
+ * \param    selection_unit* unit
+ * \param    bool copy
+ * \return   \e void
+ */
+template <typename selection_unit>
+inline void puu_node<selection_unit>::inactivate( bool copy )
+{
+  if (copy)
+  {
+    inactivate_with_snapshot(new puu_snapshot<selection_unit>(new selection_unit(*_selection_unit), 0));
+  }
+  else
+  {
+    inactivate_with_snapshot(NULL);
+  }
+}
+
+/**
+ * \brief    Inactivate the node with the given snapshot
+ * \details  The snapshot may be shared with other nodes. A NULL snapshot
+ *           stands for an inactivation without copy.
+ * \param    puu_snapshot* snapshot
+ * \return   \e void
+ */
+template <typename selection_unit>
+inline void puu_node<selection_unit>::inactivate_with_snapshot( puu_snapshot<selection_unit>* snapshot )
+{
+  assert(_active || _snapshot == NULL);
+  if (snapshot != NULL)
+  {
+    snapshot->retain();
+  }
+  _snapshot = snapshot;
+  _active   = false;
+}
+
+/**
+ * \brief    Restore the state of the node
+ * \details  Used to load checkpoints. The node is active if 'unit' is not
+ *           NULL. Else, it is inactivated with 'snapshot' (NULL if it was
+ *           inactivated without copy).
+ * \param    double time
+ * \param    selection_unit* unit
+ * \param    puu_snapshot* snapshot
+ * \return   \e void
+ */
+template <typename selection_unit>
+inline void puu_node<selection_unit>::restore( double time, selection_unit* unit, puu_snapshot<selection_unit>* snapshot )
+{
+  assert(time >= 0.0);
+  assert(unit == NULL || snapshot == NULL);
+  _insertion_time = time;
+  _selection_unit = unit;
+  _active         = (unit != NULL);
+  if (unit == NULL)
+  {
+    inactivate_with_snapshot(snapshot);
+  }
+}
+
+/**
+ * \brief    Tag the node
+ * \details  --
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+inline void puu_node<selection_unit>::tag( void )
+{
+  _tagged.store(true, std::memory_order_relaxed);
+}
+
+/**
+ * \brief    Untag the node
+ * \details  --
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+inline void puu_node<selection_unit>::untag( void )
+{
+  _tagged.store(false, std::memory_order_relaxed);
+}
+
+/*----------------------------
+ * CONSTRUCTORS
+ *----------------------------*/
+
+/**
+ * \brief    Constructor
+ * \details  Creates a MASTER_ROOT node
+ * \param    unsigned long long int identifier
+ * \return   \e void
+ */
+template <typename selection_unit>
+puu_node<selection_unit>::puu_node( unsigned long long int identifier )
+{
+  _identifier     = identifier;
+  _parent         = NULL;
+  _position       = 0;
+  _slot           = 0;
+  _child_index    = 0;
+  _node_class     = MASTER_ROOT;
+  _active         = false;
+  _tagged.store(false, std::memory_order_relaxed);
+  _insertion_time = 0.0;
+  _snapshot       = NULL;
+  _children.clear();
+}
+
+/**
+ * \brief    Active node constructor
+ * \details  Creates a new active node with its attached selection unit.
+ * \param    unsigned long long int identifier
+ * \param    double time
+ * \param    selection_unit* unit
+ * \return   \e void
+ */
+template <typename selection_unit>
+puu_node<selection_unit>::puu_node( unsigned long long int identifier, double time, selection_unit* unit )
+{
+  assert(time >= 0.0);
+  assert(unit != NULL);
+  _identifier     = identifier;
+  _parent         = NULL;
+  _position       = 0;
+  _slot           = 0;
+  _child_index    = 0;
+  _node_class     = NORMAL;
+  _active         = true;
+  _tagged.store(false, std::memory_order_relaxed);
+  _insertion_time = time;
+  _selection_unit = unit;
+  _children.clear();
+}
+
+/*----------------------------
+ * DESTRUCTORS
+ *----------------------------*/
+
+/**
+ * \brief    Destructor
+ * \details  --
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+puu_node<selection_unit>::~puu_node( void )
+{
+  if (!_active && _snapshot != NULL)
+  {
+    _snapshot->release();
+  }
+  _snapshot = NULL;
+  _children.clear();
+}
+
+/*----------------------------
+ * PUBLIC METHODS
+ *----------------------------*/
+
+/**
+ * \brief    Adds a child
+ * \details  The child records its position in the list of children
+ * \param    puu_node* node
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_node<selection_unit>::add_child( puu_node* node )
+{
+  assert(node != this);
+  assert(node->_child_index >= _children.size() || _children[node->_child_index] != node);
+  node->_child_index = (unsigned int)_children.size();
+  _children.push_back(node);
+}
+
+/**
+ * \brief    Removes a child
+ * \details  The last child takes the place of the removed one
+ * \param    puu_node* node
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_node<selection_unit>::remove_child( puu_node* node )
+{
+  size_t pos = node->_child_index;
+  if (pos >= _children.size() || _children[pos] != node)
+  {
+    printf("Error in Node::remove_child(): the node to remove does not exist. Exit.\n");
+    exit(EXIT_FAILURE);
+  }
+  _children[pos]               = _children.back();
+  _children[pos]->_child_index = (unsigned int)pos;
+  _children.pop_back();
+}
+
+/**
+ * \brief    Replaces the given child by its own children
+ * \details  The first grandchild takes the place of the removed child and the
+ *           others are appended. Only grandchildren are re-parented.
+ * \param    puu_node* child_to_remove
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_node<selection_unit>::replace_by_grandchildren( puu_node* child_to_remove )
+{
+  size_t nb_grandchildren = child_to_remove->get_number_of_children();
+  if (nb_grandchildren == 0)
+  {
+    remove_child(child_to_remove);
+    return;
+  }
+  size_t pos = child_to_remove->_child_index;
+  if (pos >= _children.size() || _children[pos] != child_to_remove)
+  {
+    printf("Error in Node::replace_by_grandchildren(): the node to remove does not exist. Exit.\n");
+    exit(EXIT_FAILURE);
+  }
+  puu_node* grandchild     = child_to_remove->get_child(0);
+  _children[pos]           = grandchild;
+  grandchild->_child_index = (unsigned int)pos;
+  grandchild->set_parent(this);
+  _children.reserve(_children.size()+nb_grandchildren-1);
+  for (size_t i = 1; i < nb_grandchildren; i++)
+  {
+    grandchild = child_to_remove->get_child(i);
+    add_child(grandchild);
+    grandchild->set_parent(this);
+  }
+}
+
+/**
+ * \brief    Tags the lineage of the node
+ * \details  --
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_node<selection_unit>::tag_lineage( void )
+{
+  tag();
+  puu_node* node = _parent;
+  while (node != NULL)
+  {
+    node->tag();
+    node = node->get_previous();
+    if (node != NULL)
+    {
+      if (node->is_tagged())
+      {
+        node = NULL;
+      }
+    }
+  }
+}
+
+/**
+ * \brief    Tags the lineage of the node, concurrently with other threads
+ * \details  Tags are set atomically. The walk stops at the first node already
+ *           tagged, as its lineage is tagged by the thread which tagged it.
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_node<selection_unit>::tag_lineage_concurrently( void )
+{
+  puu_node* node = this;
+  while (node != NULL && !node->_tagged.exchange(true, std::memory_order_relaxed))
+  {
+    node = node->_parent;
+  }
+}
+
+/**
+ * \brief    Untags the lineage of the node
+ * \details  --
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_node<selection_unit>::untag_lineage( void )
+{
+  untag();
+  puu_node* node = _parent;
+  while (node != NULL)
+  {
+    node->untag();
+    node = node->get_previous();
+    if (node != NULL)
+    {
+      if (!node->is_tagged())
+      {
+        node = NULL;
+      }
+    }
+  }
+}
+
+/*----------------------------
+ * PROTECTED METHODS
+ *----------------------------*/
+
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+/* puu_node_pool class declarations and definitions                           */
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+/**
+ * \brief   puu_node_pool class declaration
+ * \details The puu_node_pool class allocates tree nodes by blocks. Released
+ *          nodes are recycled through a free list, so that creating and
+ *          deleting nodes does not involve the heap in the general case.
+ *          Each storage slot has a generation counter, incremented when its
+ *          node is destroyed, which allows to detect stale handles.
+ */
+template <typename selection_unit>
+class puu_node_pool
+{
+
+public:
+
+  /*----------------------------
+   * CONSTRUCTORS
+   *----------------------------*/
+  puu_node_pool( void );
+  puu_node_pool( size_t block_size );
+  puu_node_pool( const puu_node_pool& pool ) = delete;
+
+  /*----------------------------
+   * DESTRUCTORS
+   *----------------------------*/
+  ~puu_node_pool( void );
+
+  /*----------------------------
+   * GETTERS
+   *----------------------------*/
+  inline size_t                    get_number_of_nodes( void ) const;
+  inline size_t                    get_capacity( void ) const;
+  inline puu_node<selection_unit>* get_node( size_t slot );
+  inline unsigned int              get_generation( size_t slot ) const;
+
+  /*----------------------------
+   * SETTERS
+   *----------------------------*/
+  puu_node_pool& operator=(const puu_node_pool&) = delete;
+
+  /*----------------------------
+   * PUBLIC METHODS
+   *----------------------------*/
+  puu_node<selection_unit>* create_node( unsigned long long int identifier );
+  puu_node<selection_unit>* create_node( unsigned long long int identifier, double time, selection_unit* unit );
+  void                      destroy_node( puu_node<selection_unit>* node );
+  void                      reserve( size_t capacity );
+
+  /*----------------------------
+   * PUBLIC ATTRIBUTES
+   *----------------------------*/
+
+protected:
+
+  /*----------------------------
+   * PROTECTED METHODS
+   *----------------------------*/
+  size_t allocate( void );
+  void   add_block( void );
+
+  /*----------------------------
+   * PROTECTED ATTRIBUTES
+   *----------------------------*/
+  std::vector<puu_node<selection_unit>*> _blocks;          /*!< Allocated blocks of nodes              */
+  std::vector<unsigned int>              _generations;     /*!< Generation counter of each slot        */
+  std::vector<size_t>                    _free_list;       /*!< Released slots available for reuse     */
+  size_t                                 _block_size;      /*!< Number of nodes per block              */
+  size_t                                 _cursor;          /*!< Next never-used slot in the last block */
+  size_t                                 _number_of_nodes; /*!< Number of nodes currently in use       */
+};
+
+/*----------------------------
+ * GETTERS
+ *----------------------------*/
+
+/**
+ * \brief    Get the number of nodes currently in use
+ * \details  --
+ * \param    void
+ * \return   \e size_t
+ */
+template <typename selection_unit>
+inline size_t puu_node_pool<selection_unit>::get_number_of_nodes( void ) const
+{
+  return _number_of_nodes;
+}
+
+/**
+ * \brief    Get the number of nodes the pool can hold without allocating
+ * \details  --
+ * \param    void
+ * \return   \e size_t
+ */
+template <typename selection_unit>
+inline size_t puu_node_pool<selection_unit>::get_capacity( void ) const
+{
+  return _blocks.size()*_block_size;
+}
+
+/**
+ * \brief    Get the storage of the given slot
+ * \details  The slot may be unused
+ * \param    size_t slot
+ * \return   \e puu_node*
+ */
+template <typename selection_unit>
+inline puu_node<selection_unit>* puu_node_pool<selection_unit>::get_node( size_t slot )
+{
+  assert(slot < get_capacity());
+  return _blocks[slot/_block_size]+slot%_block_size;
+}
+
+/**
+ * \brief    Get the generation counter of the given slot
+ * \details  --
+ * \param    size_t slot
+ * \return   \e unsigned int
+ */
+template <typename selection_unit>
+inline unsigned int puu_node_pool<selection_unit>::get_generation( size_t slot ) const
+{
+  assert(slot < _generations.size());
+  return _generations[slot];
+}
+
+/*----------------------------
+ * CONSTRUCTORS
+ *----------------------------*/
+
+/**
+ * \brief    Default constructor
+ * \details  Blocks hold 4096 nodes
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+puu_node_pool<selection_unit>::puu_node_pool( void ) : puu_node_pool(4096)
+{
+}
+
+/**
+ * \brief    Constructor
+ * \details  --
+ * \param    size_t block_size
+ * \return   \e void
+ */
+template <typename selection_unit>
+puu_node_pool<selection_unit>::puu_node_pool( size_t block_size )
+{
+  assert(block_size > 0);
+  _block_size      = block_size;
+  _cursor          = _block_size;
+  _number_of_nodes = 0;
+  _blocks.clear();
+  _generations.clear();
+  _free_list.clear();
+}
+
+/*----------------------------
+ * DESTRUCTORS
+ *----------------------------*/
+
+/**
+ * \brief    Destructor
+ * \details  Nodes still in use must have been destroyed beforehand
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+puu_node_pool<selection_unit>::~puu_node_pool( void )
+{
+  assert(_number_of_nodes == 0);
+  for (size_t i = 0; i < _blocks.size(); i++)
+  {
+    ::operator delete(_blocks[i]);
+    _blocks[i] = NULL;
+  }
+  _blocks.clear();
+  _generations.clear();
+  _free_list.clear();
+}
+
+/*----------------------------
+ * PUBLIC METHODS
+ *----------------------------*/
+
+/**
+ * \brief    Creates a MASTER_ROOT node
+ * \details  --
+ * \param    unsigned long long int identifier
+ * \return   \e puu_node*
+ */
+template <typename selection_unit>
+puu_node<selection_unit>* puu_node_pool<selection_unit>::create_node( unsigned long long int identifier )
+{
+  size_t                    slot = allocate();
+  puu_node<selection_unit>* node = new (get_node(slot)) puu_node<selection_unit>(identifier);
+  node->set_slot(slot);
+  return node;
+}
+
+/**
+ * \brief    Creates an active node
+ * \details  --
+ * \param    unsigned long long int identifier
+ * \param    double time
+ * \param    selection_unit* unit
+ * \return   \e puu_node*
+ */
+template <typename selection_unit>
+puu_node<selection_unit>* puu_node_pool<selection_unit>::create_node( unsigned long long int identifier, double time, selection_unit* unit )
+{
+  size_t                    slot = allocate();
+  puu_node<selection_unit>* node = new (get_node(slot)) puu_node<selection_unit>(identifier, time, unit);
+  node->set_slot(slot);
+  return node;
+}
+
+/**
+ * \brief    Destroys a node and gives its slot back to the pool
+ * \details  --
+ * \param    puu_node* node
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_node_pool<selection_unit>::destroy_node( puu_node<selection_unit>* node )
+{
+  assert(node != NULL);
+  assert(_number_of_nodes > 0);
+  size_t slot = node->get_slot();
+  assert(get_node(slot) == node);
+  node->~puu_node<selection_unit>();
+  _generations[slot]++;
+  _free_list.push_back(slot);
+  _number_of_nodes--;
+}
+
+/**
+ * \brief    Makes sure that the pool can hold 'capacity' nodes
+ * \details  --
+ * \param    size_t capacity
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_node_pool<selection_unit>::reserve( size_t capacity )
+{
+  while (_number_of_nodes+_free_list.size()+(_block_size-_cursor) < capacity)
+  {
+    /* The unused end of the last block is moved to the free list */
+    size_t first_slot = get_capacity()-_block_size;
+    _free_list.reserve(_free_list.size()+2*_block_size-_cursor);
+    for (size_t i = _block_size; i > _cursor; i--)
+    {
+      _free_list.push_back(first_slot+i-1);
+    }
+    add_block();
+  }
+}
+
+/*----------------------------
+ * PROTECTED METHODS
+ *----------------------------*/
+
+/**
+ * \brief    Returns a free slot
+ * \details  Released slots are reused first, then the last block is consumed
+ * \param    void
+ * \return   \e size_t
+ */
+template <typename selection_unit>
+size_t puu_node_pool<selection_unit>::allocate( void )
+{
+  size_t slot = 0;
+  if (!_free_list.empty())
+  {
+    slot = _free_list.back();
+    _free_list.pop_back();
+  }
+  else
+  {
+    if (_cursor == _block_size)
+    {
+      add_block();
+    }
+    slot = get_capacity()-_block_size+_cursor;
+    _cursor++;
+  }
+  _number_of_nodes++;
+  return slot;
+}
+
+/**
+ * \brief    Allocates a new block of nodes
+ * \details  --
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_node_pool<selection_unit>::add_block( void )
+{
+  _blocks.push_back(static_cast<puu_node<selection_unit>*>(::operator new(_block_size*sizeof(puu_node<selection_unit>))));
+  _generations.resize(_generations.size()+_block_size, 0);
+  _cursor = 0;
+}
+
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+/* puu_event_buffer class declarations and definitions                        */
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+/**
+ * \brief   puu_event_buffer class declaration
+ * \details The puu_event_buffer class records reproduction events and
+ *          inactivations without touching the tree. Each worker thread fills
+ *          its own buffer, and the tree merges all the buffers at once (see
+ *          puu_tree::merge_event_buffers()).
+ */
+template <typename selection_unit>
+class puu_event_buffer
+{
+
+public:
+
+  /*----------------------------
+   * CONSTRUCTORS
+   *----------------------------*/
+  puu_event_buffer( void );
+  puu_event_buffer( const puu_event_buffer& buffer ) = delete;
+
+  /*----------------------------
+   * DESTRUCTORS
+   *----------------------------*/
+  ~puu_event_buffer( void );
+
+  /*----------------------------
+   * GETTERS
+   *----------------------------*/
+  inline size_t          get_number_of_reproduction_events( void ) const;
+  inline size_t          get_number_of_inactivations( void ) const;
+  inline selection_unit* get_parent( size_t pos );
+  inline selection_unit* get_child( size_t pos );
+  inline double          get_time( size_t pos ) const;
+  inline selection_unit* get_inactivated_unit( size_t pos );
+  inline bool            get_copy_unit( size_t pos ) const;
+
+  /*----------------------------
+   * SETTERS
+   *----------------------------*/
+  puu_event_buffer& operator=(const puu_event_buffer&) = delete;
+
+  /*----------------------------
+   * PUBLIC METHODS
+   *----------------------------*/
+  inline void add_reproduction_event( selection_unit* parent, selection_unit* child, double time );
+  inline void inactivate( selection_unit* unit, bool copy_unit );
+  inline void clear( void );
+
+  /*----------------------------
+   * PUBLIC ATTRIBUTES
+   *----------------------------*/
+
+protected:
+
+  /*----------------------------
+   * PROTECTED METHODS
+   *----------------------------*/
+
+  /*----------------------------
+   * PROTECTED ATTRIBUTES
+   *----------------------------*/
+  std::vector<selection_unit*> _parents;           /*!< Parents of reproduction events       */
+  std::vector<selection_unit*> _children;          /*!< Children of reproduction events      */
+  std::vector<double>          _times;             /*!< Times of reproduction events         */
+  std::vector<selection_unit*> _inactivated_units; /*!< Inactivated selection units          */
+  std::vector<bool>            _copy_units;        /*!< Copy flags of inactivated units      */
+};
+
+/*----------------------------
+ * GETTERS
+ *----------------------------*/
+
+/**
+ * \brief    Get the number of recorded reproduction events
+ * \details  --
+ * \param    void
+ * \return   \e size_t
+ */
+template <typename selection_unit>
+inline size_t puu_event_buffer<selection_unit>::get_number_of_reproduction_events( void ) const
+{
+  return _children.size();
+}
+
+/**
+ * \brief    Get the number of recorded inactivations
+ * \details  --
+ * \param    void
+ * \return   \e size_t
+ */
+template <typename selection_unit>
+inline size_t puu_event_buffer<selection_unit>::get_number_of_inactivations( void ) const
+{
+  return _inactivated_units.size();
+}
+
+/**
+ * \brief    Get the parent of the reproduction event at position 'pos'
+ * \details  --
+ * \param    size_t pos
+ * \return   \e selection_unit*
+ */
+template <typename selection_unit>
+inline selection_unit* puu_event_buffer<selection_unit>::get_parent( size_t pos )
+{
+  assert(pos < _parents.size());
+  return _parents[pos];
+}
+
+/**
+ * \brief    Get the child of the reproduction event at position 'pos'
+ * \details  --
+ * \param    size_t pos
+ * \return   \e selection_unit*
+ */
+template <typename selection_unit>
+inline selection_unit* puu_event_buffer<selection_unit>::get_child( size_t pos )
+{
+  assert(pos < _children.size());
+  return _children[pos];
+}
+
+/**
+ * \brief    Get the time of the reproduction event at position 'pos'
+ * \details  --
+ * \param    size_t pos
+ * \return   \e double
+ */
+template <typename selection_unit>
+inline double puu_event_buffer<selection_unit>::get_time( size_t pos ) const
+{
+  assert(pos < _times.size());
+  return _times[pos];
+}
+
+/**
+ * \brief    Get the selection unit of the inactivation at position 'pos'
+ * \details  --
+ * \param    size_t pos
+ * \return   \e selection_unit*
+ */
+template <typename selection_unit>
+inline selection_unit* puu_event_buffer<selection_unit>::get_inactivated_unit( size_t pos )
+{
+  assert(pos < _inactivated_units.size());
+  return _inactivated_units[pos];
+}
+
+/**
+ * \brief    Get the copy flag of the inactivation at position 'pos'
+ * \details  --
+ * \param    size_t pos
+ * \return   \e bool
+ */
+template <typename selection_unit>
+inline bool puu_event_buffer<selection_unit>::get_copy_unit( size_t pos ) const
+{
+  assert(pos < _copy_units.size());
+  return _copy_units[pos];
+}
+
+/*----------------------------
+ * CONSTRUCTORS
+ *----------------------------*/
+
+/**
+ * \brief    Default constructor
+ * \details  --
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+puu_event_buffer<selection_unit>::puu_event_buffer( void )
+{
+  clear();
+}
+
+/*----------------------------
+ * DESTRUCTORS
+ *----------------------------*/
+
+/**
+ * \brief    Destructor
+ * \details  --
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+puu_event_buffer<selection_unit>::~puu_event_buffer( void )
+{
+  clear();
+}
+
+/*----------------------------
+ * PUBLIC METHODS
+ *----------------------------*/
+
+/**
+ * \brief    Records a reproduction event
+ * \details  The parent must be active in the tree when the buffers are
+ *           merged, or be born in the same buffer or in an earlier one.
+ * \param    selection_unit* parent
+ * \param    selection_unit* child
+ * \param    double time
+ * \return   \e void
+ */
+template <typename selection_unit>
+inline void puu_event_buffer<selection_unit>::add_reproduction_event( selection_unit* parent, selection_unit* child, double time )
+{
+  assert(time >= 0.0);
+  _parents.push_back(parent);
+  _children.push_back(child);
+  _times.push_back(time);
+}
+
+/**
+ * \brief    Records an inactivation
+ * \details  Only the pointer is recorded: the selection unit is copied (if
+ *           'copy_unit' is true) when the buffers are merged, so it must
+ *           stay alive and unchanged until then.
+ * \param    selection_unit* unit
+ * \param    bool copy_unit
+ * \return   \e void
+ */
+template <typename selection_unit>
+inline void puu_event_buffer<selection_unit>::inactivate( selection_unit* unit, bool copy_unit )
+{
+  _inactivated_units.push_back(unit);
+  _copy_units.push_back(copy_unit);
+}
+
+/**
+ * \brief    Removes all the recorded events
+ * \details  Buffers are kept for the next generation
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+inline void puu_event_buffer<selection_unit>::clear( void )
+{
+  _parents.clear();
+  _children.clear();
+  _times.clear();
+  _inactivated_units.clear();
+  _copy_units.clear();
+}
+
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+/* puu_projection_store class declarations and definitions                    */
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+/**
+ * \brief   puu_projection_store class declaration
+ * \details The puu_projection_store class stores fixed-size records in a
+ *          single contiguous array, indexed by node pool slots. It is used by
+ *          puu_tree to keep a compact projection of dead selection units
+ *          instead of full copies (see puu_tree::set_projection()).
+ */
+class puu_projection_store
+{
+
+public:
+
+  /*----------------------------
+   * CONSTRUCTORS
+   *----------------------------*/
+  puu_projection_store( void );
+  puu_projection_store( const puu_projection_store& store ) = delete;
+
+  /*----------------------------
+   * DESTRUCTORS
+   *----------------------------*/
+  ~puu_projection_store( void );
+
+  /*----------------------------
+   * GETTERS
+   *----------------------------*/
+  inline size_t      get_record_size( void ) const;
+  inline size_t      get_number_of_records( void ) const;
+  inline bool        is_enabled( void ) const;
+  inline const void* get_record( size_t slot ) const;
+
+  /*----------------------------
+   * SETTERS
+   *----------------------------*/
+  puu_projection_store& operator=(const puu_projection_store&) = delete;
+  inline void set_record_size( size_t record_size );
+
+  /*----------------------------
+   * PUBLIC METHODS
+   *----------------------------*/
+  inline void* create_record( size_t slot );
+  inline void  erase_record( size_t slot );
+
+  /*----------------------------
+   * PUBLIC ATTRIBUTES
+   *----------------------------*/
+
+protected:
+
+  /*----------------------------
+   * PROTECTED METHODS
+   *----------------------------*/
+
+  /*----------------------------
+   * PROTECTED ATTRIBUTES
+   *----------------------------*/
+  size_t                              _record_size;       /*!< Size of a record in bytes (0 if disabled) */
+  size_t                              _stride;            /*!< Size of a record in 8 bytes words        */
+  size_t                              _number_of_records; /*!< Number of stored records                 */
+  std::vector<unsigned long long int> _records;           /*!< Records, by node slot                    */
+  std::vector<bool>                   _present;           /*!< Indicates if a slot holds a record       */
+};
+
+/*----------------------------
+ * GETTERS
+ *----------------------------*/
+
+/**
+ * \brief    Get the size of a record in bytes
+ * \details  --
+ * \param    void
+ * \return   \e size_t
+ */
+inline size_t puu_projection_store::get_record_size( void ) const
+{
+  return _record_size;
+}
+
+/**
+ * \brief    Get the number of stored records
+ * \details  --
+ * \param    void
+ * \return   \e size_t
+ */
+inline size_t puu_projection_store::get_number_of_records( void ) const
+{
+  return _number_of_records;
+}
+
+/**
+ * \brief    Check if records are stored
+ * \details  --
+ * \param    void
+ * \return   \e bool
+ */
+inline bool puu_projection_store::is_enabled( void ) const
+{
+  return (_record_size > 0);
+}
+
+/**
+ * \brief    Get the record of a slot
+ * \details  Returns NULL if the slot holds no record
+ * \param    size_t slot
+ * \return   \e const void*
+ */
+inline const void* puu_projection_store::get_record( size_t slot ) const
+{
+  if (slot >= _present.size() || !_present[slot])
+  {
+    return NULL;
+  }
+  return &_records[slot*_stride];
+}
+
+/*----------------------------
+ * SETTERS
+ *----------------------------*/
+
+/**
+ * \brief    Set the size of a record in bytes
+ * \details  Existing records are removed
+ * \param    size_t record_size
+ * \return   \e void
+ */
+inline void puu_projection_store::set_record_size( size_t record_size )
+{
+  _record_size       = record_size;
+  _stride            = (record_size+7)/8;
+  _number_of_records = 0;
+  _records.clear();
+  _present.clear();
+}
+
+/*----------------------------
+ * CONSTRUCTORS
+ *----------------------------*/
+
+/**
+ * \brief    Default constructor
+ * \details  Records are disabled until set_record_size() is called
+ * \param    void
+ * \return   \e void
+ */
+inline puu_projection_store::puu_projection_store( void )
+{
+  set_record_size(0);
+}
+
+/*----------------------------
+ * DESTRUCTORS
+ *----------------------------*/
+
+/**
+ * \brief    Destructor
+ * \details  --
+ * \param    void
+ * \return   \e void
+ */
+inline puu_projection_store::~puu_projection_store( void )
+{
+  _records.clear();
+  _present.clear();
+}
+
+/*----------------------------
+ * PUBLIC METHODS
+ *----------------------------*/
+
+/**
+ * \brief    Creates the record of a slot
+ * \details  The record is zero-initialized. Storage grows geometrically with
+ *           the highest slot.
+ * \param    size_t slot
+ * \return   \e void*
+ */
+inline void* puu_projection_store::create_record( size_t slot )
+{
+  assert(is_enabled());
+  if (slot >= _present.size())
+  {
+    size_t size = std::max(slot+1, 2*_present.size());
+    _present.resize(size, false);
+    _records.resize(size*_stride, 0);
+  }
+  assert(!_present[slot]);
+  _present[slot] = true;
+  _number_of_records++;
+  memset(&_records[slot*_stride], 0, _stride*8);
+  return &_records[slot*_stride];
+}
+
+/**
+ * \brief    Removes the record of a slot, if any
+ * \details  --
+ * \param    size_t slot
+ * \return   \e void
+ */
+inline void puu_projection_store::erase_record( size_t slot )
+{
+  if (slot < _present.size() && _present[slot])
+  {
+    _present[slot] = false;
+    _number_of_records--;
+  }
+}
+
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+/* puu_tree_view class declarations and definitions                           */
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+/**
+ * \brief   puu_tree_view class declaration
+ * \details The puu_tree_view class gives a read-only access to a tree written
+ *          by puu_tree::write_binary_tree(). If PUUTOOLS_USE_MMAP is defined
+ *          before including puutools.h, on POSIX systems, the file is mapped
+ *          in memory, and nodes are read in place, without any allocation.
+ *          Otherwise, the file is read in a single buffer.
+ *
+ *          File format (native byte order):
+ *          - header (32 bytes): magic "PUUTREE\0", format version (uint32),
+ *            byte order mark 0x01020304 (uint32), number of nodes n (uint64),
+ *            8 reserved bytes,
+ *          - identifiers (n uint64), sorted in increasing order,
+ *          - parent positions (n uint64, NO_PARENT for roots),
+ *          - insertion times (n doubles),
+ *          - node classes (n uint8),
+ *          - active flags (n uint8).
+ *          A parent is always stored before its children.
+ */
+class puu_tree_view
+{
+
+public:
+
+  /*----------------------------
+   * CONSTRUCTORS
+   *----------------------------*/
+  puu_tree_view( void ) = delete;
+  puu_tree_view( std::string filename );
+  puu_tree_view( const puu_tree_view& view ) = delete;
+
+  /*----------------------------
+   * DESTRUCTORS
+   *----------------------------*/
+  ~puu_tree_view( void );
+
+  /*----------------------------
+   * GETTERS
+   *----------------------------*/
+  inline size_t                 get_number_of_nodes( void ) const;
+  inline unsigned long long int get_identifier( size_t pos ) const;
+  inline bool                   has_parent( size_t pos ) const;
+  inline size_t                 get_parent( size_t pos ) const;
+  inline double                 get_insertion_time( size_t pos ) const;
+  inline puu_node_class         get_node_class( size_t pos ) const;
+  inline bool                   is_active( size_t pos ) const;
+
+  /*----------------------------
+   * SETTERS
+   *----------------------------*/
+  puu_tree_view& operator=(const puu_tree_view&) = delete;
+
+  /*----------------------------
+   * PUBLIC METHODS
+   *----------------------------*/
+  inline size_t find( unsigned long long int identifier ) const;
+
+  /*----------------------------
+   * PUBLIC ATTRIBUTES
+   *----------------------------*/
+  static const unsigned int           FORMAT_VERSION = 1;                  /*!< Binary format version        */
+  static const size_t                 HEADER_SIZE    = 32;                 /*!< Header size in bytes         */
+  static const unsigned long long int NO_PARENT      = 0xFFFFFFFFFFFFFFFF; /*!< Parent position of roots     */
+
+protected:
+
+  /*----------------------------
+   * PROTECTED METHODS
+   *----------------------------*/
+
+  /*----------------------------
+   * PROTECTED ATTRIBUTES
+   *----------------------------*/
+  void*                         _data;            /*!< Mapped or loaded file    */
+  size_t                        _data_size;       /*!< File size                */
+  size_t                        _number_of_nodes; /*!< Number of nodes          */
+  const unsigned long long int* _identifiers;     /*!< Identifiers column       */
+  const unsigned long long int* _parents;         /*!< Parent positions column  */
+  const double*                 _times;           /*!< Insertion times column   */
+  const unsigned char*          _classes;         /*!< Node classes column      */
+  const unsigned char*          _active;          /*!< Active flags column      */
+};
+
+/*----------------------------
+ * GETTERS
+ *----------------------------*/
+
+/**
+ * \brief    Get the number of nodes
+ * \details  --
+ * \param    void
+ * \return   \e size_t
+ */
+inline size_t puu_tree_view::get_number_of_nodes( void ) const
+{
+  return _number_of_nodes;
+}
+
+/**
+ * \brief    Get the identifier of the node at position 'pos'
+ * \details  --
+ * \param    size_t pos
+ * \return   \e unsigned long long int
+ */
+inline unsigned long long int puu_tree_view::get_identifier( size_t pos ) const
+{
+  assert(pos < _number_of_nodes);
+  return _identifiers[pos];
+}
+
+/**
+ * \brief    Check if the node at position 'pos' has a parent
+ * \details  Roots have no parent
+ * \param    size_t pos
+ * \return   \e bool
+ */
+inline bool puu_tree_view::has_parent( size_t pos ) const
+{
+  assert(pos < _number_of_nodes);
+  return (_parents[pos] != NO_PARENT);
+}
+
+/**
+ * \brief    Get the position of the parent of the node at position 'pos'
+ * \details  --
+ * \param    size_t pos
+ * \return   \e size_t
+ */
+inline size_t puu_tree_view::get_parent( size_t pos ) const
+{
+  assert(has_parent(pos));
+  return (size_t)_parents[pos];
+}
+
+/**
+ * \brief    Get the insertion time of the node at position 'pos'
+ * \details  --
+ * \param    size_t pos
+ * \return   \e double
+ */
+inline double puu_tree_view::get_insertion_time( size_t pos ) const
+{
+  assert(pos < _number_of_nodes);
+  return _times[pos];
+}
+
+/**
+ * \brief    Get the class of the node at position 'pos'
+ * \details  --
+ * \param    size_t pos
+ * \return   \e puu_node_class
+ */
+inline puu_node_class puu_tree_view::get_node_class( size_t pos ) const
+{
+  assert(pos < _number_of_nodes);
+  return (puu_node_class)_classes[pos];
+}
+
+/**
+ * \brief    Check if the node at position 'pos' is active
+ * \details  --
+ * \param    size_t pos
+ * \return   \e bool
+ */
+inline bool puu_tree_view::is_active( size_t pos ) const
+{
+  assert(pos < _number_of_nodes);
+  return (_active[pos] != 0);
+}
+
+/*----------------------------
+ * CONSTRUCTORS
+ *----------------------------*/
+
+/**
+ * \brief    Constructor
+ * \details  Maps (or loads) the file in memory and checks its header
+ * \param    std::string filename
+ * \return   \e void
+ */
+inline puu_tree_view::puu_tree_view( std::string filename )
+{
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 1) Map the file                   */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+#ifdef PUUTOOLS_MMAP
+  int         fd = open(filename.c_str(), O_RDONLY);
+  struct stat file_stat;
+  if (fd < 0 || fstat(fd, &file_stat) != 0 || (size_t)file_stat.st_size < HEADER_SIZE)
+  {
+    printf("Error in puu_tree_view::puu_tree_view(): cannot read file %s. Exit.\n", filename.c_str());
+    exit(EXIT_FAILURE);
+  }
+  _data_size = (size_t)file_stat.st_size;
+  _data      = mmap(NULL, _data_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (_data == MAP_FAILED)
+  {
+    printf("Error in puu_tree_view::puu_tree_view(): cannot map file %s. Exit.\n", filename.c_str());
+    exit(EXIT_FAILURE);
+  }
+#else
+  std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+  if (!file || (size_t)file.tellg() < HEADER_SIZE)
+  {
+    printf("Error in puu_tree_view::puu_tree_view(): cannot read file %s. Exit.\n", filename.c_str());
+    exit(EXIT_FAILURE);
+  }
+  _data_size = (size_t)file.tellg();
+  _data      = ::operator new(_data_size);
+  file.seekg(0);
+  file.read((char*)_data, (std::streamsize)_data_size);
+  file.close();
+#endif
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 2) Check the header               */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  const char*            header     = (const char*)_data;
+  unsigned int           version    = 0;
+  unsigned int           byte_order = 0;
+  unsigned long long int n          = 0;
+  memcpy(&version, header+8, 4);
+  memcpy(&byte_order, header+12, 4);
+  memcpy(&n, header+16, 8);
+  if (memcmp(header, "PUUTREE", 8) != 0 || version != FORMAT_VERSION || byte_order != 0x01020304 || n > (_data_size-HEADER_SIZE)/26 || _data_size != HEADER_SIZE+26*n)
+  {
+    printf("Error in puu_tree_view::puu_tree_view(): %s is not a valid tree file (version %u). Exit.\n", filename.c_str(), FORMAT_VERSION);
+    exit(EXIT_FAILURE);
+  }
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 3) Locate the columns             */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  _number_of_nodes = (size_t)n;
+  _identifiers     = (const unsigned long long int*)(header+HEADER_SIZE);
+  _parents         = (const unsigned long long int*)(header+HEADER_SIZE+8*n);
+  _times           = (const double*)(header+HEADER_SIZE+16*n);
+  _classes         = (const unsigned char*)(header+HEADER_SIZE+24*n);
+  _active          = (const unsigned char*)(header+HEADER_SIZE+25*n);
+}
+
+/*----------------------------
+ * DESTRUCTORS
+ *----------------------------*/
+
+/**
+ * \brief    Destructor
+ * \details  --
+ * \param    void
+ * \return   \e void
+ */
+inline puu_tree_view::~puu_tree_view( void )
+{
+#ifdef PUUTOOLS_MMAP
+  munmap(_data, _data_size);
+#else
+  ::operator delete(_data);
+#endif
+  _data = NULL;
+}
+
+/*----------------------------
+ * PUBLIC METHODS
+ *----------------------------*/
+
+/**
+ * \brief    Find the position of a node by its identifier
+ * \details  Returns get_number_of_nodes() if the node does not exist
+ * \param    unsigned long long int identifier
+ * \return   \e size_t
+ */
+inline size_t puu_tree_view::find( unsigned long long int identifier ) const
+{
+  const unsigned long long int* it = std::lower_bound(_identifiers, _identifiers+_number_of_nodes, identifier);
+  if (it == _identifiers+_number_of_nodes || *it != identifier)
+  {
+    return _number_of_nodes;
+  }
+  return (size_t)(it-_identifiers);
+}
+
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+/* puu_tree class declarations and definitions                                */
+/*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+/**
+ * \brief   puu_tree class declaration
+ * \details The puu_tree class manages a lineage or coalescence tree
+ */
+template <typename selection_unit>
+class puu_tree
+{
+
+public:
+
+  /*----------------------------
+   * CONSTRUCTORS
+   *----------------------------*/
+  puu_tree( void );
+  puu_tree( puu_update_mode mode );
+  puu_tree( puu_update_mode mode, bool map_units );
+  puu_tree( const puu_tree& tree ) = delete;
+
+  /*----------------------------
+   * DESTRUCTORS
+   *----------------------------*/
+  ~puu_tree( void );
+
+  /*----------------------------
+   * GETTERS
+   *----------------------------*/
+  inline size_t                    get_number_of_nodes( void ) const;
+  inline puu_update_mode           get_update_mode( void ) const;
+  inline size_t                    get_number_of_threads( void ) const;
+  inline size_t                    get_number_of_event_buffers( void ) const;
+  inline int                       get_output_precision( void ) const;
+  inline puu_event_buffer<selection_unit>* get_event_buffer( size_t pos );
+
+  template <typename record>
+  const record* get_projection( puu_node<selection_unit>* node ) const;
+  inline puu_node<selection_unit>* get_node_by_identifier( unsigned long long int identifier );
+  inline puu_node<selection_unit>* get_node_by_selection_unit( selection_unit* unit );
+  inline puu_node<selection_unit>* get_node_by_handle( puu_handle handle );
+  inline puu_handle                get_handle( puu_node<selection_unit>* node ) const;
+  inline bool                      is_valid( puu_handle handle ) const;
+  inline puu_node<selection_unit>* get_first( void );
+  inline puu_node<selection_unit>* get_next( void );
+  inline void                      get_active_node_identifiers( std::vector<unsigned long long int>* active_node_identifiers );
+  inline puu_node<selection_unit>* get_common_ancestor( void );
+  inline double                    get_common_ancestor_age( void );
+  inline bool                      is_ancestor( puu_node<selection_unit>* ancestor, puu_node<selection_unit>* node );
+  inline puu_node<selection_unit>* get_common_ancestor( puu_node<selection_unit>* first_node, puu_node<selection_unit>* second_node );
+  void                             get_common_ancestors( const std::vector<selection_unit*>& first_units, const std::vector<selection_unit*>& second_units, std::vector<puu_node<selection_unit>*>* ancestors, std::vector<double>* times );
+  inline bool                      is_coalescence_node( puu_node<selection_unit>* node );
+  inline puu_node<selection_unit>* get_coalescence_parent( puu_node<selection_unit>* node );
+  inline puu_node<selection_unit>* get_coalescence_child( puu_node<selection_unit>* node, size_t pos );
+
+  /*----------------------------
+   * SETTERS
+   *----------------------------*/
+  puu_tree& operator=(const puu_tree&) = delete;
+
+  inline void set_number_of_threads( size_t number_of_threads );
+  inline void set_output_precision( int precision );
+
+  template <typename record>
+  void set_projection( std::function<void(const selection_unit&, record&)> projector );
+
+  void set_snapshot_sharing( std::function<size_t(const selection_unit&)> hash, std::function<bool(const selection_unit&, const selection_unit&)> equal );
+  void set_common_ancestor_callback( std::function<void(puu_node<selection_unit>*)> callback );
+  void set_trunk_spilling( std::string filename, std::function<void(const selection_unit&, std::ostream&)> serializer );
+  void set_delta_snapshots( std::function<void(const selection_unit&, const selection_unit&, std::string&)> encoder, std::function<void(selection_unit&, const std::string&)> decoder, unsigned int keyframe_interval, size_t cache_size );
+  void set_memory_budget( size_t memory_budget, std::string filename, std::function<void(const selection_unit&, std::ostream&)> serializer, std::function<selection_unit*(std::istream&)> deserializer );
+
+  /*----------------------------
+   * PUBLIC METHODS
+   *----------------------------*/
+  puu_handle add_root( selection_unit* unit );
+  puu_handle add_reproduction_event( selection_unit* parent, selection_unit* child, double time );
+  puu_handle add_reproduction_event( puu_handle parent, selection_unit* child, double time );
+  void       add_reproduction_events( const std::vector<selection_unit*>& parents, const std::vector<selection_unit*>& children, double time );
+  void       inactivate( selection_unit* unit, bool copy_unit );
+  void       inactivate( puu_handle handle, bool copy_unit );
+  void       inactivate_all( const std::vector<selection_unit*>& units, bool copy_units );
+  void       create_event_buffers( size_t number_of_buffers );
+  void       update_ancestry_index( void );
+  void       update_common_ancestor_index( void );
+  void       merge_event_buffers( void );
+  void update_as_lineage_tree( void );
+  void update_as_coalescence_tree( void );
+  void write_tree( std::string filename );
+  void write_newick_tree( std::string filename );
+  void write_coalescence_newick_tree( std::string filename );
+  void write_binary_tree( std::string filename );
+  void write_tables( std::string node_filename, std::string edge_filename, double present_time );
+  void write_lineage_table( std::string filename, std::string time_header, const std::vector< std::pair<std::string, std::function<double(const selection_unit&)> > >& columns );
+  void write_line_of_descent( std::string filename, selection_unit* unit, std::string time_header, const std::vector< std::pair<std::string, std::function<double(const selection_unit&)> > >& columns );
+  void save_checkpoint( std::string filename, const std::vector<selection_unit*>& active_units, std::function<void(const selection_unit&, std::ostream&)> serializer );
+  std::vector<puu_handle> load_checkpoint( std::string filename, const std::vector<selection_unit*>& active_units, std::function<selection_unit*(std::istream&)> deserializer );
+  /*----------------------------
+   * PUBLIC ATTRIBUTES
+   *----------------------------*/
+
+protected:
+
+  /*----------------------------
+   * PROTECTED METHODS
+   *----------------------------*/
+  void prune( void );
+  void shorten( void );
+  void run_in_parallel( const std::function<void(size_t, size_t, size_t)>& task );
+  puu_node<selection_unit>*     create_child_node( puu_node<selection_unit>* parent_node, selection_unit* child, double time );
+  void                          inactivate_node( puu_node<selection_unit>* node, bool copy_unit );
+  void                          inactivate_kept_node( puu_node<selection_unit>* node, bool copy_unit );
+  puu_snapshot<selection_unit>* share_snapshot( puu_node<selection_unit>* node );
+  void                          reserve( size_t number_of_new_nodes );
+  void store_node( puu_node<selection_unit>* node );
+  void delete_node( puu_node<selection_unit>* node );
+  void live_update( puu_node<selection_unit>* node );
+  void track_common_ancestor( void );
+  void spill_trunk( void );
+  void compact_node_vector( void );
+  void inOrderNewick( puu_node<selection_unit>* root, std::vector< std::pair<puu_node<selection_unit>*, size_t> >& stack, puu_output_buffer& output, bool coalescence_view );
+  void write_lineage_header( puu_output_buffer& output, const std::string& time_header, const std::vector< std::pair<std::string, std::function<double(const selection_unit&)> > >& columns );
+  void write_lineage_row( puu_output_buffer& output, puu_node<selection_unit>* node, const std::vector< std::pair<std::string, std::function<double(const selection_unit&)> > >& columns );
+  void tag_tree();
+  void untag_tree();
+  void tag_offspring( puu_node<selection_unit>* node, std::vector<puu_node<selection_unit>*>* tagged_nodes );
+
+  /*----------------------------
+   * PROTECTED ATTRIBUTES
+   *----------------------------*/
+  puu_update_mode                                                _update_mode;        /*!< Tree update mode                            */
+  unsigned long long int                                         _current_id;         /*!< Current node id                             */
+  puu_node_pool<selection_unit>                                  _pool;               /*!< Tree nodes storage                          */
+  std::vector<puu_node<selection_unit>*>                         _node_vector;        /*!< Tree nodes, sorted by identifier            */
+  std::vector<unsigned long long int>                            _identifier_vector;  /*!< Identifiers of the node vector entries      */
+  size_t                                                         _number_of_nodes;    /*!< Number of nodes in the tree                 */
+  size_t                                                         _number_of_holes;    /*!< Number of deleted entries in the node vector */
+  bool                                                           _map_units;          /*!< Indicates if selection units are mapped     */
+  size_t                                                         _number_of_threads;  /*!< Number of threads used to prune the tree    */
+  int                                                            _output_precision;   /*!< Significant digits of exported times        */
+  std::vector<puu_event_buffer<selection_unit>*>                 _event_buffers;      /*!< Event buffers of worker threads             */
+  puu_projection_store                                           _projections;        /*!< Projections of dead selection units         */
+  std::function<void(const selection_unit&, void*)>              _projector;          /*!< Builds the projection of a selection unit   */
+  std::function<size_t(const selection_unit&)>                   _snapshot_hash;      /*!< Hash of shared snapshots                    */
+  std::function<bool(const selection_unit&,
+                     const selection_unit&)>                     _snapshot_equal;     /*!< Equality of shared snapshots                */
+  puu_delta_codec<selection_unit>*                               _delta_codec;        /*!< Codec of delta snapshots (NULL if disabled) */
+  puu_snapshot_store<selection_unit>*                            _snapshot_store;     /*!< Store of evicted copies (NULL if disabled)  */
+  puu_node<selection_unit>*                                      _mrca;               /*!< Most recent common ancestor of active nodes */
+  unsigned long long int                                         _mrca_identifier;    /*!< Identifier of the last notified ancestor    */
+  std::function<void(puu_node<selection_unit>*)>                 _mrca_callback;      /*!< Called when the common ancestor changes     */
+  std::vector<char>                                              _trunk_buffer;       /*!< Stream buffer of the trunk file             */
+  std::ofstream                                                  _trunk_file;         /*!< Append-only file of the spilled trunk       */
+  std::function<void(const selection_unit&, std::ostream&)>      _trunk_serializer;   /*!< Serializer of spilled selection units       */
+  unsigned long long int                                         _trunk_identifier;   /*!< Identifier of the last spilled node         */
+  puu_snapshot<selection_unit>*                                  _trunk_snapshot;     /*!< Snapshot of the last spilled node           */
+  unsigned long long int                                         _trunk_owner;        /*!< Identifier of the first node sharing it     */
+  bool                                                           _ancestry_dirty;     /*!< Indicates if the ancestry index is outdated */
+  std::vector< std::pair<size_t, size_t> >                       _ancestry_labels;    /*!< Pre-order interval of each node, by slot    */
+  bool                                                           _lca_dirty;          /*!< Indicates if the ancestor index is outdated */
+  std::vector<puu_node<selection_unit>*>                         _lca_order;          /*!< Nodes by pre-order rank                     */
+  std::vector<unsigned int>                                      _lca_depths;         /*!< Node depths by pre-order rank               */
+  std::vector< std::vector<unsigned int> >                       _lca_table;          /*!< Sparse table of shallowest parent ranks     */
+  std::vector<unsigned char>                                     _lca_log;            /*!< Binary logarithms of range lengths          */
+  std::unordered_map<selection_unit*, puu_node<selection_unit>*> _unit_map;           /*!< Selection units map                         */
+  size_t                                                         _iterator;           /*!< Node vector iterator                        */
+};
+
+/*----------------------------
+ * GETTERS
+ *----------------------------*/
+
+/**
+ * \brief    Get the number of nodes in the tree
+ * \details  --
+ * \param    void
+ * \return   \e size_t
+ */
+template <typename selection_unit>
+inline size_t puu_tree<selection_unit>::get_number_of_nodes( void ) const
+{
+  return _number_of_nodes;
+}
+
+/**
+ * \brief    Get the update mode of the tree
+ * \details  --
+ * \param    void
+ * \return   \e puu_update_mode
+ */
+template <typename selection_unit>
+inline puu_update_mode puu_tree<selection_unit>::get_update_mode( void ) const
+{
+  return _update_mode;
+}
+
+/**
+ * \brief    Get the number of threads used to prune the tree
+ * \details  --
+ * \param    void
+ * \return   \e size_t
+ */
+template <typename selection_unit>
+inline size_t puu_tree<selection_unit>::get_number_of_threads( void ) const
+{
+  return _number_of_threads;
+}
+
+/**
+ * \brief    Get the number of event buffers
+ * \details  --
+ * \param    void
+ * \return   \e size_t
+ */
+template <typename selection_unit>
+inline size_t puu_tree<selection_unit>::get_number_of_event_buffers( void ) const
+{
+  return _event_buffers.size();
+}
+
+/**
+ * \brief    Get the number of significant digits of exported times
+ * \details  0 stands for the shortest representation that reads back exactly
+ * \param    void
+ * \return   \e int
+ */
+template <typename selection_unit>
+inline int puu_tree<selection_unit>::get_output_precision( void ) const
+{
+  return _output_precision;
+}
+
+/**
+ * \brief    Get the event buffer at position 'pos'
+ * \details  Each worker thread must use its own buffer
+ * \param    size_t pos
+ * \return   \e puu_event_buffer*
+ */
+template <typename selection_unit>
+inline puu_event_buffer<selection_unit>* puu_tree<selection_unit>::get_event_buffer( size_t pos )
+{
+  assert(pos < _event_buffers.size());
+  return _event_buffers[pos];
+}
+
+/**
+ * \brief    Get the projection of the selection unit of a dead node
+ * \details  Returns NULL if the node has no projection (see set_projection())
+ * \param    puu_node* node
+ * \return   \e const record*
+ */
+template <typename selection_unit>
+template <typename record>
+const record* puu_tree<selection_unit>::get_projection( puu_node<selection_unit>* node ) const
+{
+  assert(sizeof(record) == _projections.get_record_size());
+  return (const record*)_projections.get_record(node->get_slot());
+}
+
+/**
+ * \brief    Get the node by its identifier
+ * \details  Returns NULL if the node does not exist. The node vector being
+ *           sorted by identifier, the node is found by binary search. The
+ *           selection unit of an inactive node is only valid until later
+ *           reads (see puu_node::get_selection_unit()).
+ * \param    unsigned long long int identifier
+ * \return   \e Node*
+ */
+template <typename selection_unit>
+inline puu_node<selection_unit>* puu_tree<selection_unit>::get_node_by_identifier( unsigned long long int identifier )
+{
+  std::vector<unsigned long long int>::iterator it = std::lower_bound(_identifier_vector.begin(), _identifier_vector.end(), identifier);
+  if (it != _identifier_vector.end() && *it == identifier)
+  {
+    return _node_vector[it-_identifier_vector.begin()];
+  }
+  return NULL;
+}
+
+/**
+ * \brief    Get the node by selection unit
+ * \details  Returns NULL if the node does not exist, or if selection units are
+ *           not mapped. The node must be active. The selection unit of an
+ *           inactive node is only valid until later reads (see
+ *           puu_node::get_selection_unit()).
+ * \param    selection_unit* unit
+ * \return   \e puu_node*
+ */
+template <typename selection_unit>
+inline puu_node<selection_unit>* puu_tree<selection_unit>::get_node_by_selection_unit( selection_unit* unit )
+{
+  typename std::unordered_map<selection_unit*, puu_node<selection_unit>*>::iterator it = _unit_map.find(unit);
+  if (it != _unit_map.end())
+  {
+    assert(it->second->is_active());
+    return it->second;
+  }
+  return NULL;
+}
+
+/**
+ * \brief    Get the node by handle
+ * \details  Returns NULL if the node has been deleted. The selection unit of
+ *           an inactive node is only valid until later reads (see
+ *           puu_node::get_selection_unit()).
+ * \param    puu_handle handle
+ * \return   \e puu_node*
+ */
+template <typename selection_unit>
+inline puu_node<selection_unit>* puu_tree<selection_unit>::get_node_by_handle( puu_handle handle )
+{
+  if (is_valid(handle))
+  {
+    return _pool.get_node(handle.slot);
+  }
+  return NULL;
+}
+
+/**
+ * \brief    Get the handle of a node
+ * \details  --
+ * \param    puu_node* node
+ * \return   \e puu_handle
+ */
+template <typename selection_unit>
+inline puu_handle puu_tree<selection_unit>::get_handle( puu_node<selection_unit>* node ) const
+{
+  assert(node != NULL);
+  puu_handle handle;
+  handle.slot       = node->get_slot();
+  handle.generation = _pool.get_generation(node->get_slot());
+  return handle;
+}
+
+/**
+ * \brief    Check if the handle still refers to a node of the tree
+ * \details  --
+ * \param    puu_handle handle
+ * \return   \e bool
+ */
+template <typename selection_unit>
+inline bool puu_tree<selection_unit>::is_valid( puu_handle handle ) const
+{
+  return (handle.slot < _pool.get_capacity() && _pool.get_generation(handle.slot) == handle.generation);
+}
+
+/**
+ * \brief    Get the first node of the tree
+ * \details  Returns NULL if the tree only contains the master root
+ * \param    void
+ * \return   \e puu_node*
+ */
+template <typename selection_unit>
+inline puu_node<selection_unit>* puu_tree<selection_unit>::get_first( void )
+{
+  _iterator = 0;
+  return get_next();
+}
+
+/**
+ * \brief    Get the next node
+ * \details  Returns NULL if the end of the node vector is reached. Nodes are
+ *           visited by increasing identifier.
+ * \param    void
+ * \return   \e puu_node*
+ */
+template <typename selection_unit>
+inline puu_node<selection_unit>* puu_tree<selection_unit>::get_next( void )
+{
+  _iterator++;
+  while (_iterator < _node_vector.size() && _node_vector[_iterator] == NULL)
+  {
+    _iterator++;
+  }
+  if (_iterator >= _node_vector.size())
+  {
+    return NULL;
+  }
+  return _node_vector[_iterator];
+}
+
+/**
+ * \brief    Get the list of active node identifiers
+ * \details  --
+ * \param    std::vector<unsigned long long int>* active_node_identifiers
+ * \return   \e void
+ */
+template <typename selection_unit>
+inline void puu_tree<selection_unit>::get_active_node_identifiers( std::vector<unsigned long long int>* active_node_identifiers )
+{
+  active_node_identifiers->clear();
+  for (size_t i = 0; i < _node_vector.size(); i++)
+  {
+    if (_node_vector[i] != NULL && _node_vector[i]->is_active())
+    {
+      active_node_identifiers->push_back(_node_vector[i]->get_identifier());
+    }
+  }
+}
+
+/**
+ * \brief    Get the common ancestor
+ * \details  Returns the most recent common ancestor of all active nodes, or
+ *           NULL if the population is extincted or if the tree is
+ *           multi-rooted. It is tracked at each inactivation: with deferred
+ *           updates, it may be an older common ancestor until the next
+ *           update of the tree.
+ * \param    void
+ * \return   \e puu_node*
+ */
+template <typename selection_unit>
+inline puu_node<selection_unit>* puu_tree<selection_unit>::get_common_ancestor( void )
+{
+  return _mrca;
+}
+
+/**
+ * \brief    Check if 'ancestor' is an ancestor of 'node'
+ * \details  Nodes are labelled by the interval of pre-order ranks of their
+ *           subtree, so that the query takes a constant time. Labels are
+ *           rebuilt after any change of the tree structure (see
+ *           update_ancestry_index()).
+ * \param    puu_node* ancestor
+ * \param    puu_node* node
+ * \return   \e bool
+ */
+template <typename selection_unit>
+inline bool puu_tree<selection_unit>::is_ancestor( puu_node<selection_unit>* ancestor, puu_node<selection_unit>* node )
+{
+  update_ancestry_index();
+  const std::pair<size_t, size_t>& ancestor_label = _ancestry_labels[ancestor->get_slot()];
+  size_t                           node_rank      = _ancestry_labels[node->get_slot()].first;
+  return (ancestor_label.first < node_rank && node_rank <= ancestor_label.second);
+}
+
+/**
+ * \brief    Get the most recent common ancestor of two nodes
+ * \details  The common ancestor is the parent of lowest depth among the nodes
+ *           ranked between both nodes in pre-order, found in constant time
+ *           with a sparse table (see update_common_ancestor_index()). A node
+ *           is its own common ancestor with its descendants. Returns NULL if
+ *           the nodes only share the master root.
+ * \param    puu_node* first_node
+ * \param    puu_node* second_node
+ * \return   \e puu_node*
+ */
+template <typename selection_unit>
+inline puu_node<selection_unit>* puu_tree<selection_unit>::get_common_ancestor( puu_node<selection_unit>* first_node, puu_node<selection_unit>* second_node )
+{
+  update_common_ancestor_index();
+  size_t first_rank  = _ancestry_labels[first_node->get_slot()].first;
+  size_t second_rank = _ancestry_labels[second_node->get_slot()].first;
+  if (first_rank == second_rank)
+  {
+    return first_node;
+  }
+  if (first_rank > second_rank)
+  {
+    std::swap(first_rank, second_rank);
+  }
+  size_t       level  = _lca_log[second_rank-first_rank];
+  unsigned int left   = _lca_table[level][first_rank+1];
+  unsigned int right  = _lca_table[level][second_rank+1-((size_t)1 << level)];
+  unsigned int lowest = (_lca_depths[left] <= _lca_depths[right] ? left : right);
+  if (lowest == 0)
+  {
+    return NULL;
+  }
+  return _lca_order[lowest];
+}
+
+/**
+ * \brief    Get the common ancestor age
+ * \details  Returns the insertion time of the most recent common ancestor (see
+ *           get_common_ancestor()). If the tree is multi-rooted, returns the
+ *           mean of root ages.
+ * \param    void
+ * \return   \e double
+ */
+template <typename selection_unit>
+inline double puu_tree<selection_unit>::get_common_ancestor_age( void )
+{
+  puu_node<selection_unit>* master_root = _node_vector[0];
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 1) If there is a unique common ancestor   */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  if (_mrca != NULL)
+  {
+    return _mrca->get_insertion_time();
+  }
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 2) If the population went extincte        */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  else if (master_root->get_number_of_children() == 0)
+  {
+    return 0.0;
+  }
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 3) If there are multiple common ancestors */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  else
+  {
+    double mean = 0.0;
+    for (size_t i = 0; i < master_root->get_number_of_children(); i++)
+    {
+      mean += master_root->get_child(i)->get_insertion_time();
+    }
+    return mean/master_root->get_number_of_children();
+  }
+}
+
+/**
+ * \brief    Get the most recent common ancestors of pairs of selection units
+ * \details  The i-th entry of 'ancestors' and 'times' is the common ancestor
+ *           of first_units[i] and second_units[i], and its insertion time
+ *           (NULL and 0 if both units only share the master root)
+ * \param    const std::vector<selection_unit*>& first_units
+ * \param    const std::vector<selection_unit*>& second_units
+ * \param    std::vector<puu_node*>* ancestors
+ * \param    std::vector<double>* times
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_tree<selection_unit>::get_common_ancestors( const std::vector<selection_unit*>& first_units, const std::vector<selection_unit*>& second_units, std::vector<puu_node<selection_unit>*>* ancestors, std::vector<double>* times )
+{
+  assert(first_units.size() == second_units.size());
+  update_common_ancestor_index();
+  ancestors->resize(first_units.size());
+  times->resize(first_units.size());
+  for (size_t i = 0; i < first_units.size(); i++)
+  {
+    puu_node<selection_unit>* first_node  = get_node_by_selection_unit(first_units[i]);
+    puu_node<selection_unit>* second_node = get_node_by_selection_unit(second_units[i]);
+    assert(first_node != NULL && second_node != NULL);
+    puu_node<selection_unit>* ancestor    = get_common_ancestor(first_node, second_node);
+    (*ancestors)[i]                       = ancestor;
+    (*times)[i]                           = (ancestor != NULL ? ancestor->get_insertion_time() : 0.0);
+  }
+}
+
+/**
+ * \brief    Check if a node belongs to the coalescence view of the tree
+ * \details  The coalescence view skips inactive nodes with a single child,
+ *           as update_as_coalescence_tree() would remove them
+ * \param    puu_node* node
+ * \return   \e bool
+ */
+template <typename selection_unit>
+inline bool puu_tree<selection_unit>::is_coalescence_node( puu_node<selection_unit>* node )
+{
+  return (!node->is_master_root() && (node->is_active() || node->get_number_of_children() != 1));
+}
+
+/**
+ * \brief    Get the parent of a node in the coalescence view
+ * \details  Returns NULL if the node is a root of the coalescence view
+ * \param    puu_node* node
+ * \return   \e puu_node*
+ */
+template <typename selection_unit>
+inline puu_node<selection_unit>* puu_tree<selection_unit>::get_coalescence_parent( puu_node<selection_unit>* node )
+{
+  puu_node<selection_unit>* parent = node->get_previous();
+  while (!parent->is_master_root() && !is_coalescence_node(parent))
+  {
+    parent = parent->get_previous();
+  }
+  return (parent->is_master_root() ? NULL : parent);
+}
+
+/**
+ * \brief    Get the child at position 'pos' in the coalescence view
+ * \details  The chain of inactive nodes with a single child below the child
+ *           is skipped
+ * \param    puu_node* node
+ * \param    size_t pos
+ * \return   \e puu_node*
+ */
+template <typename selection_unit>
+inline puu_node<selection_unit>* puu_tree<selection_unit>::get_coalescence_child( puu_node<selection_unit>* node, size_t pos )
+{
+  puu_node<selection_unit>* child = node->get_child(pos);
+  while (!is_coalescence_node(child))
+  {
+    child = child->get_child(0);
+  }
+  return child;
+}
+
+/*----------------------------
+ * SETTERS
+ *----------------------------*/
+
+/**
+ * \brief    Set the number of threads used to prune the tree
+ * \details  Lineage tagging and the search for dead nodes are then shared
+ *           between threads. The result does not depend on the number of
+ *           threads (1 by default).
+ * \param    size_t number_of_threads
+ * \return   \e void
+ */
+template <typename selection_unit>
+inline void puu_tree<selection_unit>::set_number_of_threads( size_t number_of_threads )
+{
+  assert(number_of_threads > 0);
+  _number_of_threads = number_of_threads;
+}
+
+/**
+ * \brief    Set the number of significant digits of exported times
+ * \details  Used by write_newick_tree(), write_coalescence_newick_tree(),
+ *           write_tables(), write_lineage_table() and
+ *           write_line_of_descent(). The default is 6 digits, as
+ *           std::ostream. 0 stands for the shortest representation that
+ *           reads back exactly.
+ * \param    int precision
+ * \return   \e void
+ */
+template <typename selection_unit>
+inline void puu_tree<selection_unit>::set_output_precision( int precision )
+{
+  assert(precision >= 0 && precision <= 17);
+  _output_precision = precision;
+}
+
+/**
+ * \brief    Store projections of dead selection units instead of copies
+ * \details  Once set, inactivating a selection unit with a copy stores the
+ *           record built by 'projector' in a side store, and the selection
+ *           unit itself is not copied. Records must be trivially copyable and
+ *           are read back with get_projection(). Must be set before the first
+ *           inactivation, and before set_trunk_spilling() (the record size
+ *           is written in the trunk file header).
+ * \param    std::function<void(const selection_unit&, record&)> projector
+ * \return   \e void
+ */
+template <typename selection_unit>
+template <typename record>
+void puu_tree<selection_unit>::set_projection( std::function<void(const selection_unit&, record&)> projector )
+{
+  static_assert(std::is_trivially_copyable<record>::value, "projection records must be trivially copyable");
+  static_assert(alignof(record) <= 8, "projection records must be aligned on 8 bytes at most");
+  assert(_projections.get_number_of_records() == 0);
+  if (_trunk_file.is_open())
+  {
+    printf("Error in puu_tree::set_projection(): the projection must be set before trunk spilling. Exit.\n");
+    exit(EXIT_FAILURE);
+  }
+  _projections.set_record_size(sizeof(record));
+  _projector = [projector]( const selection_unit& unit, void* data )
+  {
+    projector(unit, *(record*)data);
+  };
+}
+
+/**
+ * \brief    Share snapshots between identical selection units
+ * \details  Once set, a selection unit inactivated with a copy reuses the
+ *           snapshot of its parental node when both have the same hash and
+ *           are equal, so that a clonal chain holds a single copy.
+ * \param    std::function<size_t(const selection_unit&)> hash
+ * \param    std::function<bool(const selection_unit&, const selection_unit&)> equal
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_tree<selection_unit>::set_snapshot_sharing( std::function<size_t(const selection_unit&)> hash, std::function<bool(const selection_unit&, const selection_unit&)> equal )
+{
+  _snapshot_hash  = hash;
+  _snapshot_equal = equal;
+}
+
+/**
+ * \brief    Set the function called when the common ancestor changes
+ * \details  callback(node) is called each time the most recent common
+ *           ancestor of active nodes moves to a new node (e.g. a fixation).
+ *           inactivate_all() only reports the common ancestor reached at
+ *           the end of the batch.
+ * \param    std::function<void(puu_node*)> callback
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_tree<selection_unit>::set_common_ancestor_callback( std::function<void(puu_node<selection_unit>*)> callback )
+{
+  _mrca_callback = callback;
+}
+
+/**
+ * \brief    Spill the trunk of the lineage tree to an append-only file
+ * \details  After each call to update_as_lineage_tree(), the nodes above the
+ *           most recent common ancestor can no longer change: they are
+ *           appended to the file and deleted from the tree, the common
+ *           ancestor becoming the root. Selection units copies are written
+ *           with serializer(unit, stream). An existing trunk file is
+ *           continued (e.g. after load_checkpoint()). The projection, if
+ *           any, must be set before.
+ *           File format: a 24 bytes header ("PUUTRNK\0", version, byte order
+ *           mark, projection record size, reserved), followed by one record
+ *           per node, from the oldest. The trunk being a single lineage, the
+ *           parent of a node is the previous record. A record holds the
+ *           identifier, the parental identifier (0 for the first record, or
+ *           for the first one after a checkpoint was loaded), the position
+ *           among the children of the parent (always 0), the insertion time,
+ *           the node class, the state and its payload, with the same layout
+ *           as the node records of save_checkpoint() (version 2): 0 (no
+ *           copy), 1 (hash and serialized unit), 3 (projection record) or 4
+ *           (identifier of the first node sharing the same snapshot).
+ *           Version 1 trunk files, whose records have no child position,
+ *           are not continued.
+ * \param    std::string filename
+ * \param    std::function<void(const selection_unit&, std::ostream&)> serializer
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_tree<selection_unit>::set_trunk_spilling( std::string filename, std::function<void(const selection_unit&, std::ostream&)> serializer )
+{
+  if (_trunk_file.is_open())
+  {
+    printf("Error in puu_tree::set_trunk_spilling(): trunk spilling is already set. Exit.\n");
+    exit(EXIT_FAILURE);
+  }
+  unsigned int version     = 2;
+  unsigned int byte_order  = 0x01020304;
+  unsigned int record_size = (unsigned int)_projections.get_record_size();
+  unsigned int reserved    = 0;
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 1) Check an existing trunk file   */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  std::ifstream previous(filename.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+  bool          existing = (previous && previous.tellg() > 0);
+  if (existing)
+  {
+    char header[24];
+    previous.seekg(0);
+    previous.read(header, 24);
+    if (!previous || memcmp(header, "PUUTRNK", 8) != 0 || memcmp(header+8, &version, 4) != 0 || memcmp(header+12, &byte_order, 4) != 0 || memcmp(header+16, &record_size, 4) != 0)
+    {
+      printf("Error in puu_tree::set_trunk_spilling(): file %s is not a compatible trunk file. Exit.\n", filename.c_str());
+      exit(EXIT_FAILURE);
+    }
+  }
+  previous.close();
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 2) Open the file for appending    */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  _trunk_buffer.resize(1048576);
+  _trunk_file.rdbuf()->pubsetbuf(&_trunk_buffer[0], (std::streamsize)_trunk_buffer.size());
+  _trunk_file.open(filename.c_str(), std::ios::out | std::ios::app | std::ios::binary);
+  if (!_trunk_file)
+  {
+    printf("Error in puu_tree::set_trunk_spilling(): cannot write file %s. Exit.\n", filename.c_str());
+    exit(EXIT_FAILURE);
+  }
+  if (!existing)
+  {
+    _trunk_file.write("PUUTRNK", 8);
+    _trunk_file.write((const char*)&version, 4);
+    _trunk_file.write((const char*)&byte_order, 4);
+    _trunk_file.write((const char*)&record_size, 4);
+    _trunk_file.write((const char*)&reserved, 4);
+    _trunk_file.flush();
+  }
+  _trunk_serializer = serializer;
+}
+
+/**
+ * \brief    Store snapshots as deltas relative to their parental snapshot
+ * \details  Once set, a selection unit inactivated with a copy is stored as
+ *           the delta written by encoder(parent_copy, unit, delta), with a
+ *           full copy every 'keyframe_interval' snapshots along a lineage.
+ *           get_selection_unit() rebuilds the unit with decoder(unit, delta),
+ *           and keeps the last 'cache_size' rebuilt units, which are owned
+ *           by the cache and not counted in the memory budget (see
+ *           set_memory_budget()). Must be set before the first inactivation.
+ * \param    std::function<void(const selection_unit&, const selection_unit&, std::string&)> encoder
+ * \param    std::function<void(selection_unit&, const std::string&)> decoder
+ * \param    unsigned int keyframe_interval
+ * \param    size_t cache_size
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_tree<selection_unit>::set_delta_snapshots( std::function<void(const selection_unit&, const selection_unit&, std::string&)> encoder, std::function<void(selection_unit&, const std::string&)> decoder, unsigned int keyframe_interval, size_t cache_size )
+{
+  if (_delta_codec != NULL)
+  {
+    printf("Error in puu_tree::set_delta_snapshots(): delta snapshots are already set. Exit.\n");
+    exit(EXIT_FAILURE);
+  }
+  _delta_codec = new puu_delta_codec<selection_unit>(encoder, decoder, keyframe_interval, cache_size);
+}
+
+/**
+ * \brief    Keep the copies of dead selection units within a memory budget
+ * \details  Once set, the least recently used full copies are deleted when
+ *           resident copies exceed 'memory_budget' bytes. A copy is written
+ *           by serializer(unit, stream) in a backing file (memory-mapped and
+ *           unlinked at once when PUUTOOLS_USE_MMAP is defined) when it is
+ *           first evicted, and its bytes are reused once it is deleted.
+ *           get_selection_unit() reads them back with deserializer(stream),
+ *           the copy remaining valid until it is evicted again. Nodes,
+ *           active selection units, and the units rebuilt from delta
+ *           snapshots (see set_delta_snapshots()) stay in memory and are not
+ *           counted in the budget.
+ * \param    size_t memory_budget
+ * \param    std::string filename
+ * \param    std::function<void(const selection_unit&, std::ostream&)> serializer
+ * \param    std::function<selection_unit*(std::istream&)> deserializer
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_tree<selection_unit>::set_memory_budget( size_t memory_budget, std::string filename, std::function<void(const selection_unit&, std::ostream&)> serializer, std::function<selection_unit*(std::istream&)> deserializer )
+{
+  if (_snapshot_store != NULL)
+  {
+    printf("Error in puu_tree::set_memory_budget(): the memory budget is already set. Exit.\n");
+    exit(EXIT_FAILURE);
+  }
+  _snapshot_store = new puu_snapshot_store<selection_unit>(filename, memory_budget, serializer, deserializer);
+  for (size_t pos = 1; pos < _node_vector.size(); pos++)
+  {
+    if (_node_vector[pos] != NULL && _node_vector[pos]->get_snapshot() != NULL)
+    {
+      _snapshot_store->store(_node_vector[pos]->get_snapshot());
+    }
+  }
+}
+
+/*----------------------------
+ * CONSTRUCTORS
+ *----------------------------*/
+
+/**
+ * \brief    Default constructor
+ * \details  The tree is initialized with one node called the master root.
+ *           Updates are deferred.
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+puu_tree<selection_unit>::puu_tree( void ) : puu_tree(DEFERRED_UPDATES, true)
+{
+}
+
+/**
+ * \brief    Constructor
+ * \details  The tree is initialized with one node called the master root
+ * \param    puu_update_mode mode
+ * \return   \e void
+ */
+template <typename selection_unit>
+puu_tree<selection_unit>::puu_tree( puu_update_mode mode ) : puu_tree(mode, true)
+{
+}
+
+/**
+ * \brief    Constructor
+ * \details  The tree is initialized with one node called the master root. If
+ *           map_units is false, active nodes can only be reached through
+ *           their handles, and methods taking selection units as parameters
+ *           cannot be used (except add_root()).
+ * \param    puu_update_mode mode
+ * \param    bool map_units
+ * \return   \e void
+ */
+template <typename selection_unit>
+puu_tree<selection_unit>::puu_tree( puu_update_mode mode, bool map_units )
+{
+  _update_mode       = mode;
+  _map_units         = map_units;
+  _number_of_threads = 1;
+  _output_precision  = 6;
+  _delta_codec       = NULL;
+  _snapshot_store    = NULL;
+  _mrca              = NULL;
+  _mrca_identifier   = 0;
+  _trunk_identifier  = 0;
+  _trunk_snapshot    = NULL;
+  _trunk_owner       = 0;
+  _ancestry_dirty    = true;
+  _ancestry_labels.clear();
+  _lca_dirty         = true;
+  _event_buffers.clear();
+  _current_id      = 0;
+  _number_of_nodes = 0;
+  _number_of_holes = 0;
+  _iterator        = 0;
+  _node_vector.clear();
+  _identifier_vector.clear();
+  puu_node<selection_unit>* master_root = _pool.create_node(_current_id);
+  store_node(master_root);
+}
+
+/*----------------------------
+ * DESTRUCTORS
+ *----------------------------*/
+
+/**
+ * \brief    Destructor
+ * \details  --
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+puu_tree<selection_unit>::~puu_tree( void )
+{
+  for (size_t i = 0; i < _node_vector.size(); i++)
+  {
+    if (_node_vector[i] != NULL)
+    {
+      _pool.destroy_node(_node_vector[i]);
+      _node_vector[i] = NULL;
+    }
+  }
+  _node_vector.clear();
+  _identifier_vector.clear();
+  _unit_map.clear();
+  for (size_t i = 0; i < _event_buffers.size(); i++)
+  {
+    delete _event_buffers[i];
+    _event_buffers[i] = NULL;
+  }
+  _event_buffers.clear();
+  if (_trunk_snapshot != NULL)
+  {
+    _trunk_snapshot->release();
+    _trunk_snapshot = NULL;
+  }
+  if (_trunk_file.is_open())
+  {
+    _trunk_file.close();
+  }
+  delete _delta_codec;
+  _delta_codec = NULL;
+  delete _snapshot_store;
+  _snapshot_store = NULL;
+}
+
+/*----------------------------
+ * PUBLIC METHODS
+ *----------------------------*/
+
+/**
+ * \brief    Adds a root to the tree
+ * \details  --
+ * \param    selection_unit* unit
+ * \return   \e puu_handle
+ */
+template <typename selection_unit>
+puu_handle puu_tree<selection_unit>::add_root( selection_unit* unit )
+{
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 1) Get the master root          */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  puu_node<selection_unit>* master_root = _node_vector[0];
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 2) Create the root              */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  _current_id++;
+  puu_node<selection_unit>* root = _pool.create_node(_current_id, 0.0, unit);
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 3) Connect nodes                */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  root->as_root();
+  root->set_parent(master_root);
+  master_root->add_child(root);
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 4) Add the root to the tree     */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  store_node(root);
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 5) Add the root to the unit map */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  if (_map_units)
+  {
+    assert(_unit_map.find(unit) == _unit_map.end());
+    _unit_map[unit] = root;
+  }
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 6) The common ancestor may move */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  _mrca = NULL;
+  track_common_ancestor();
+  return get_handle(root);
+}
+
+/**
+ * \brief    Adds a reproduction event to the tree
+ * \details  --
+ * \param    selection_unit* parent
+ * \param    selection_unit* child
+ * \param    double time
+ * \return   \e puu_handle
+ */
+template <typename selection_unit>
+puu_handle puu_tree<selection_unit>::add_reproduction_event( selection_unit* parent, selection_unit* child, double time )
+{
+  assert(time >= 0.0);
+  assert(_map_units);
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 1) Get parental node              */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  typename std::unordered_map<selection_unit*, puu_node<selection_unit>*>::iterator it = _unit_map.find(parent);
+  assert(it != _unit_map.end());
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 2) Create child node              */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  return get_handle(create_child_node(it->second, child, time));
+}
+
+/**
+ * \brief    Adds a reproduction event to the tree
+ * \details  The parental node is given by its handle
+ * \param    puu_handle parent
+ * \param    selection_unit* child
+ * \param    double time
+ * \return   \e puu_handle
+ */
+template <typename selection_unit>
+puu_handle puu_tree<selection_unit>::add_reproduction_event( puu_handle parent, selection_unit* child, double time )
+{
+  assert(time >= 0.0);
+  assert(is_valid(parent));
+  return get_handle(create_child_node(_pool.get_node(parent.slot), child, time));
+}
+
+/**
+ * \brief    Adds a batch of reproduction events to the tree
+ * \details  The i-th child descends from the i-th parent. The tree storage is
+ *           sized once for the whole batch, and the parental node is looked
+ *           up once per run of consecutive events sharing the same parent.
+ *           A batch grouped by parent (each parent in a single run) is added
+ *           in its own order. Otherwise, runs are grouped by parent with a
+ *           counting sort (parents in order of first appearance, children
+ *           in batch order), so that the children of a parent are still
+ *           created together.
+ * \param    const std::vector<selection_unit*>& parents
+ * \param    const std::vector<selection_unit*>& children
+ * \param    double time
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_tree<selection_unit>::add_reproduction_events( const std::vector<selection_unit*>& parents, const std::vector<selection_unit*>& children, double time )
+{
+  assert(time >= 0.0);
+  assert(_map_units);
+  assert(parents.size() == children.size());
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 1) Size the storage once          */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  reserve(children.size());
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 2) Look up the parent of each run */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  std::vector<size_t>                    run_starts;
+  std::vector<puu_node<selection_unit>*> run_parents;
+  bool                                   grouped = true;
+  for (size_t i = 0; i < children.size(); i++)
+  {
+    if (i == 0 || parents[i] != parents[i-1])
+    {
+      typename std::unordered_map<selection_unit*, puu_node<selection_unit>*>::iterator it = _unit_map.find(parents[i]);
+      assert(it != _unit_map.end());
+      if (!run_parents.empty() && it->second->get_identifier() <= run_parents.back()->get_identifier())
+      {
+        grouped = false;
+      }
+      run_starts.push_back(i);
+      run_parents.push_back(it->second);
+    }
+  }
+  run_starts.push_back(children.size());
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 3) Check if a parent comes back   */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  size_t                                                   number_of_runs = run_parents.size();
+  std::vector< std::pair<unsigned long long int, size_t> > run_keys;
+  if (!grouped)
+  {
+    run_keys.reserve(number_of_runs);
+    for (size_t r = 0; r < number_of_runs; r++)
+    {
+      run_keys.push_back(std::make_pair(run_parents[r]->get_identifier(), r));
+    }
+    std::sort(run_keys.begin(), run_keys.end());
+    grouped = true;
+    for (size_t k = 1; k < number_of_runs && grouped; k++)
+    {
+      grouped = (run_keys[k].first != run_keys[k-1].first);
+    }
+  }
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 4) Order the runs                 */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  std::vector<size_t> sorted_runs;
+  if (!grouped)
+  {
+    /* The first run of a parent leads the runs of this parent */
+    std::vector<size_t> leaders(number_of_runs);
+    std::vector<size_t> offsets(number_of_runs+1, 0);
+    for (size_t k = 0; k < number_of_runs; k++)
+    {
+      size_t leader               = (k > 0 && run_keys[k].first == run_keys[k-1].first ? leaders[run_keys[k-1].second] : run_keys[k].second);
+      leaders[run_keys[k].second] = leader;
+      offsets[leader+1]++;
+    }
+    for (size_t r = 0; r < number_of_runs; r++)
+    {
+      offsets[r+1] += offsets[r];
+    }
+    sorted_runs.resize(number_of_runs);
+    for (size_t r = 0; r < number_of_runs; r++)
+    {
+      sorted_runs[offsets[leaders[r]]++] = r;
+    }
+  }
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 5) Create child nodes             */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  for (size_t k = 0; k < number_of_runs; k++)
+  {
+    size_t r = (grouped ? k : sorted_runs[k]);
+    for (size_t i = run_starts[r]; i < run_starts[r+1]; i++)
+    {
+      create_child_node(run_parents[r], children[i], time);
+    }
+  }
+}
+
+/**
+ * \brief    Inactivates the node belonging to the provided selection unit
+ * \details  If copy_unit is set to true, a local copy of the selection unit is made.
+ *           With live updates, a node which does not belong to the tree anymore
+ *           is removed immediately (no copy is made in this case).
+ * \param    selection_unit* unit
+ * \param    bool copy_unit
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_tree<selection_unit>::inactivate( selection_unit* unit, bool copy_unit )
+{
+  assert(_map_units);
+  typename std::unordered_map<selection_unit*, puu_node<selection_unit>*>::iterator it = _unit_map.find(unit);
+  assert(it != _unit_map.end());
+  puu_node<selection_unit>* node = it->second;
+  _unit_map.erase(it);
+  inactivate_node(node, copy_unit);
+}
+
+/**
+ * \brief    Inactivates the node referred to by the handle
+ * \details  See inactivate()
+ * \param    puu_handle handle
+ * \param    bool copy_unit
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_tree<selection_unit>::inactivate( puu_handle handle, bool copy_unit )
+{
+  assert(is_valid(handle));
+  puu_node<selection_unit>* node = _pool.get_node(handle.slot);
+  if (_map_units)
+  {
+    _unit_map.erase(node->get_selection_unit());
+  }
+  inactivate_node(node, copy_unit);
+}
+
+/**
+ * \brief    Inactivates the nodes belonging to the provided selection units
+ * \details  See inactivate(). With live updates, nodes are first removed
+ *           from the youngest to the oldest, so that a node whose
+ *           descendants all die in the same batch is removed without being
+ *           copied. The remaining nodes are then copied from the oldest to
+ *           the youngest, so that snapshots can be shared with parents
+ *           dying in the same batch. The common ancestor is updated once,
+ *           at the end of the batch.
+ * \param    const std::vector<selection_unit*>& units
+ * \param    bool copy_units
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_tree<selection_unit>::inactivate_all( const std::vector<selection_unit*>& units, bool copy_units )
+{
+  assert(_map_units);
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 1) Find the nodes                         */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  std::vector< std::pair<unsigned long long int, puu_node<selection_unit>*> > nodes;
+  nodes.reserve(units.size());
+  for (size_t i = 0; i < units.size(); i++)
+  {
+    typename std::unordered_map<selection_unit*, puu_node<selection_unit>*>::iterator it = _unit_map.find(units[i]);
+    if (it == _unit_map.end())
+    {
+      printf("Error in puu_tree::inactivate_all(): selection unit %zu is not in the tree. Exit.\n", i);
+      exit(EXIT_FAILURE);
+    }
+    nodes.push_back(std::make_pair(it->second->get_identifier(), it->second));
+    _unit_map.erase(it);
+  }
+  std::sort(nodes.begin(), nodes.end());
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 2) Remove dead nodes, youngest first      */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  if (_update_mode != DEFERRED_UPDATES)
+  {
+    for (size_t i = nodes.size(); i > 0; i--)
+    {
+      puu_node<selection_unit>* node      = nodes[i-1].second;
+      bool                      extinct   = (node->get_number_of_children() == 0);
+      bool                      coalesced = (_update_mode == LIVE_COALESCENCE && node->get_number_of_children() == 1);
+      if (extinct || coalesced)
+      {
+        node->inactivate(false);
+        live_update(node);
+        nodes[i-1].second = NULL;
+      }
+    }
+  }
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 3) Copy the remaining nodes, oldest first */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  for (size_t i = 0; i < nodes.size(); i++)
+  {
+    if (nodes[i].second != NULL)
+    {
+      inactivate_kept_node(nodes[i].second, copy_units);
+    }
+  }
+  track_common_ancestor();
+}
+
+/**
+ * \brief    Creates the event buffers of worker threads
+ * \details  Existing buffers must be empty
+ * \param    size_t number_of_buffers
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_tree<selection_unit>::create_event_buffers( size_t number_of_buffers )
+{
+  for (size_t i = number_of_buffers; i < _event_buffers.size(); i++)
+  {
+    assert(_event_buffers[i]->get_number_of_reproduction_events() == 0);
+    assert(_event_buffers[i]->get_number_of_inactivations() == 0);
+    delete _event_buffers[i];
+    _event_buffers[i] = NULL;
+  }
+  size_t old_size = _event_buffers.size();
+  _event_buffers.resize(number_of_buffers, NULL);
+  for (size_t i = old_size; i < number_of_buffers; i++)
+  {
+    _event_buffers[i] = new puu_event_buffer<selection_unit>();
+  }
+}
+
+/**
+ * \brief    Merges the events recorded in the event buffers into the tree
+ * \details  Must be called while no worker thread is recording. Reproduction
+ *           events are added buffer after buffer, in their recording order,
+ *           so that node identifiers do not depend on threads scheduling.
+ *           The parent of an event must thus be active, or be born in the
+ *           same buffer or in an earlier one. Inactivations are applied
+ *           afterwards, in the same order, and copy the selection units at
+ *           this point: their units must be active in the tree. Buffers are
+ *           emptied.
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_tree<selection_unit>::merge_event_buffers( void )
+{
+  assert(_map_units);
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 1) Size the storage once          */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  size_t number_of_events = 0;
+  for (size_t i = 0; i < _event_buffers.size(); i++)
+  {
+    number_of_events += _event_buffers[i]->get_number_of_reproduction_events();
+  }
+  reserve(number_of_events);
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 2) Add reproduction events        */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  selection_unit*           last_parent = NULL;
+  puu_node<selection_unit>* parent_node = NULL;
+  for (size_t i = 0; i < _event_buffers.size(); i++)
+  {
+    puu_event_buffer<selection_unit>* buffer = _event_buffers[i];
+    for (size_t j = 0; j < buffer->get_number_of_reproduction_events(); j++)
+    {
+      if (buffer->get_parent(j) != last_parent)
+      {
+        typename std::unordered_map<selection_unit*, puu_node<selection_unit>*>::iterator it = _unit_map.find(buffer->get_parent(j));
+        if (it == _unit_map.end())
+        {
+          printf("Error in puu_tree::merge_event_buffers(): the parent of event %zu of buffer %zu is not in the tree. Exit.\n", j, i);
+          exit(EXIT_FAILURE);
+        }
+        last_parent = buffer->get_parent(j);
+        parent_node = it->second;
+      }
+      create_child_node(parent_node, buffer->get_child(j), buffer->get_time(j));
+    }
+  }
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 3) Apply inactivations            */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  for (size_t i = 0; i < _event_buffers.size(); i++)
+  {
+    puu_event_buffer<selection_unit>* buffer = _event_buffers[i];
+    for (size_t j = 0; j < buffer->get_number_of_inactivations(); j++)
+    {
+      typename std::unordered_map<selection_unit*, puu_node<selection_unit>*>::iterator it = _unit_map.find(buffer->get_inactivated_unit(j));
+      if (it == _unit_map.end())
+      {
+        printf("Error in puu_tree::merge_event_buffers(): the unit of inactivation %zu of buffer %zu is not in the tree. Exit.\n", j, i);
+        exit(EXIT_FAILURE);
+      }
+      puu_node<selection_unit>* node = it->second;
+      _unit_map.erase(it);
+      inactivate_node(node, buffer->get_copy_unit(j));
+    }
+    buffer->clear();
+  }
+}
+
+/**
+ * \brief    Rebuilds the ancestry index if the tree has changed
+ * \details  Each node is labelled by its pre-order rank and the highest rank
+ *           of its subtree. Called by is_ancestor(). Must be called first when
+ *           is_ancestor() is used by several threads.
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_tree<selection_unit>::update_ancestry_index( void )
+{
+  if (!_ancestry_dirty)
+  {
+    return;
+  }
+  _ancestry_labels.resize(_pool.get_capacity());
+  std::vector< std::pair<puu_node<selection_unit>*, size_t> > stack;
+  size_t                                                      rank = 0;
+  stack.push_back(std::make_pair(_node_vector[0], (size_t)0));
+  _ancestry_labels[_node_vector[0]->get_slot()].first = rank;
+  while (!stack.empty())
+  {
+    puu_node<selection_unit>* node       = stack.back().first;
+    size_t                    next_child = stack.back().second;
+    if (next_child < node->get_number_of_children())
+    {
+      puu_node<selection_unit>* child = node->get_child(next_child);
+      stack.back().second++;
+      rank++;
+      _ancestry_labels[child->get_slot()].first = rank;
+      stack.push_back(std::make_pair(child, (size_t)0));
+    }
+    else
+    {
+      _ancestry_labels[node->get_slot()].second = rank;
+      stack.pop_back();
+    }
+  }
+  _ancestry_dirty = false;
+}
+
+/**
+ * \brief    Rebuilds the common ancestor index if the tree has changed
+ * \details  Nodes are ordered by pre-order rank (see update_ancestry_index()),
+ *           and the sparse table stores, for each range of 2^k ranks, the
+ *           rank of the shallowest parent of the range. Called by
+ *           get_common_ancestor(). Must be called first when common ancestors
+ *           are queried by several threads.
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_tree<selection_unit>::update_common_ancestor_index( void )
+{
+  update_ancestry_index();
+  if (!_lca_dirty)
+  {
+    return;
+  }
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 1) Order nodes by pre-order rank  */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  size_t n = _number_of_nodes;
+  _lca_order.resize(n);
+  _lca_depths.resize(n);
+  for (size_t pos = 0; pos < _node_vector.size(); pos++)
+  {
+    if (_node_vector[pos] != NULL)
+    {
+      _lca_order[_ancestry_labels[_node_vector[pos]->get_slot()].first] = _node_vector[pos];
+    }
+  }
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 2) Build the first level          */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  _lca_log.resize(n+1);
+  _lca_log[0] = 0;
+  _lca_log[1] = 0;
+  for (size_t i = 2; i <= n; i++)
+  {
+    _lca_log[i] = (unsigned char)(_lca_log[i/2]+1);
+  }
+  _lca_table.resize((size_t)_lca_log[n]+1);
+  _lca_table[0].resize(n);
+  _lca_table[0][0] = 0;
+  _lca_depths[0]   = 0;
+  for (size_t rank = 1; rank < n; rank++)
+  {
+    unsigned int parent_rank = (unsigned int)_ancestry_labels[_lca_order[rank]->get_previous()->get_slot()].first;
+    _lca_table[0][rank]      = parent_rank;
+    _lca_depths[rank]        = _lca_depths[parent_rank]+1;
+  }
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 3) Build the next levels          */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  for (size_t level = 1; level < _lca_table.size(); level++)
+  {
+    size_t half = (size_t)1 << (level-1);
+    _lca_table[level].resize(n+1-2*half);
+    for (size_t i = 0; i+2*half <= n; i++)
+    {
+      unsigned int left    = _lca_table[level-1][i];
+      unsigned int right   = _lca_table[level-1][i+half];
+      _lca_table[level][i] = (_lca_depths[left] <= _lca_depths[right] ? left : right);
+    }
+  }
+  _lca_dirty = false;
+}
+
+/**
+ * \brief    Update the tree as a lineage tree
+ * \details  Prune dead branches.
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_tree<selection_unit>::update_as_lineage_tree( void )
+{
+  if (_update_mode == DEFERRED_UPDATES)
+  {
+    prune();
+  }
+  track_common_ancestor();
+  spill_trunk();
+}
+
+/**
+ * \brief    Update the tree as a coalescence tree
+ * \details  Prune dead branches and shorten the tree.
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_tree<selection_unit>::update_as_coalescence_tree( void )
+{
+  if (_update_mode == DEFERRED_UPDATES)
+  {
+    prune();
+  }
+  if (_update_mode != LIVE_COALESCENCE)
+  {
+    shorten();
+  }
+  track_common_ancestor();
+}
+
+/**
+ * \brief    Writes tree in a text file
+ * \details  Writes adjacency list in a file (.txt).
+ * \param    std::string filename
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_tree<selection_unit>::write_tree( std::string filename )
+{
+  std::ofstream file(filename.c_str(), std::ios::out | std::ios::trunc);
+  {
+    puu_output_buffer output(file, 1048576);
+    for (size_t pos = 0; pos < _node_vector.size(); pos++)
+    {
+      if (_node_vector[pos] == NULL)
+      {
+        continue;
+      }
+      for (size_t i = 0; i < _node_vector[pos]->get_number_of_children(); i++)
+      {
+        output.append(_node_vector[pos]->get_identifier());
+        output.append(' ');
+        output.append(_node_vector[pos]->get_child(i)->get_identifier());
+        output.append('\n');
+      }
+    }
+  }
+  file.close();
+}
+
+/**
+ * \brief    Writes Newick tree
+ * \details  Writes tree in Newick format in a file (.phb), through a 1MB buffer
+ * \param    std::string filename
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_tree<selection_unit>::write_newick_tree( std::string filename )
+{
+  std::ofstream file(filename.c_str(), std::ios::out | std::ios::trunc);
+  std::vector< std::pair<puu_node<selection_unit>*, size_t> > stack;
+  {
+    puu_output_buffer output(file, 1048576);
+    output.set_precision(_output_precision);
+    for (size_t i = 0; i < _node_vector[0]->get_number_of_children(); i++)
+    {
+      inOrderNewick(_node_vector[0]->get_child(i), stack, output, false);
+      output.append(";\n", 2);
+    }
+  }
+  file.close();
+}
+
+/**
+ * \brief    Writes the coalescence view of a lineage tree in Newick format
+ * \details  Inactive nodes with a single child are skipped, so that the
+ *           output describes the coalescence tree of the same population,
+ *           without maintaining it. The tree must be up to date (see
+ *           update_as_lineage_tree()).
+ * \param    std::string filename
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_tree<selection_unit>::write_coalescence_newick_tree( std::string filename )
+{
+  std::ofstream file(filename.c_str(), std::ios::out | std::ios::trunc);
+  std::vector< std::pair<puu_node<selection_unit>*, size_t> > stack;
+  {
+    puu_output_buffer output(file, 1048576);
+    output.set_precision(_output_precision);
+    for (size_t i = 0; i < _node_vector[0]->get_number_of_children(); i++)
+    {
+      inOrderNewick(get_coalescence_child(_node_vector[0], i), stack, output, true);
+      output.append(";\n", 2);
+    }
+  }
+  file.close();
+}
+
+/**
+ * \brief    Writes tree in binary format
+ * \details  Writes the nodes (except the master root) in identifier order, as
+ *           columns of identifiers, parent positions, insertion times, node
+ *           classes and active flags (see puu_tree_view for the format). The
+ *           file can be opened with puu_tree_view.
+ * \param    std::string filename
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_tree<selection_unit>::write_binary_tree( std::string filename )
+{
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 1) Compute node positions in file */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  unsigned long long int              no_parent = puu_tree_view::NO_PARENT;
+  std::vector<unsigned long long int> file_positions(_node_vector.size(), no_parent);
+  unsigned long long int              n         = 0;
+  for (size_t pos = 1; pos < _node_vector.size(); pos++)
+  {
+    if (_node_vector[pos] != NULL)
+    {
+      file_positions[pos] = n;
+      n++;
+    }
+  }
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 2) Write the header               */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  std::ofstream file(filename.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+  {
+    puu_output_buffer output(file, 1048576);
+    unsigned int           version    = puu_tree_view::FORMAT_VERSION;
+    unsigned int           byte_order = 0x01020304;
+    unsigned long long int reserved   = 0;
+    output.append("PUUTREE", 8);
+    output.append((const char*)&version, 4);
+    output.append((const char*)&byte_order, 4);
+    output.append((const char*)&n, 8);
+    output.append((const char*)&reserved, 8);
+
+    /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+    /* 3) Write the columns              */
+    /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+    for (int column = 0; column < 5; column++)
+    {
+      for (size_t pos = 1; pos < _node_vector.size(); pos++)
+      {
+        puu_node<selection_unit>* node = _node_vector[pos];
+        if (node == NULL)
+        {
+          continue;
+        }
+        if (column == 0)
+        {
+          unsigned long long int identifier = node->get_identifier();
+          output.append((const char*)&identifier, 8);
+        }
+        else if (column == 1)
+        {
+          output.append((const char*)&file_positions[node->get_previous()->get_position()], 8);
+        }
+        else if (column == 2)
+        {
+          double time = node->get_insertion_time();
+          output.append((const char*)&time, 8);
+        }
+        else if (column == 3)
+        {
+          output.append((char)node->get_node_class());
+        }
+        else
+        {
+          output.append((char)node->is_active());
+        }
+      }
+    }
   }
-  return NULL;
+  file.close();
 }
 
 /**
- * \brief    Get the node by selection unit
- * \details  Returns NULL if the node does not exist. The node must be active.
- * \param    selection_unit* unit
- * \return   \e puu_node*
+ * \brief    Writes the tree as node and edge tables
+ * \details  Writes tab-separated tables in the text format of tskit
+ *           (tskit.load_text()), in a single pass over the node vector.
+ *           Nodes (except the master root) are written in identifier order,
+ *           with their row as 'id', active nodes as samples, their age
+ *           relative to 'present_time' as 'time', and their identifier. An
+ *           edge over the interval [0, 1) links each node to its parent (by
+ *           rows). Parents being older, they are always written first.
+ * \param    std::string node_filename
+ * \param    std::string edge_filename
+ * \param    double present_time
+ * \return   \e void
  */
 template <typename selection_unit>
-inline puu_node<selection_unit>* puu_tree<selection_unit>::get_node_by_selection_unit( selection_unit* unit )
+void puu_tree<selection_unit>::write_tables( std::string node_filename, std::string edge_filename, double present_time )
 {
-  if (_unit_map.find(unit) != _unit_map.end())
+  std::ofstream                       node_file(node_filename.c_str(), std::ios::out | std::ios::trunc);
+  std::ofstream                       edge_file(edge_filename.c_str(), std::ios::out | std::ios::trunc);
+  std::vector<unsigned long long int> rows(_node_vector.size(), 0);
+  unsigned long long int              n = 0;
   {
-    assert(_unit_map[unit]->is_active());
-    return _unit_map[unit];
+    puu_output_buffer nodes(node_file, 1048576);
+    puu_output_buffer edges(edge_file, 1048576);
+    nodes.set_precision(_output_precision);
+    edges.set_precision(_output_precision);
+    nodes.append("id\tis_sample\ttime\tidentifier\n", 29);
+    edges.append("left\tright\tparent\tchild\n", 24);
+    for (size_t pos = 1; pos < _node_vector.size(); pos++)
+    {
+      puu_node<selection_unit>* node = _node_vector[pos];
+      if (node == NULL)
+      {
+        continue;
+      }
+
+      /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+      /* 1) Write the node row             */
+      /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+      rows[pos] = n;
+      nodes.append(n);
+      nodes.append('\t');
+      nodes.append(node->is_active() ? '1' : '0');
+      nodes.append('\t');
+      nodes.append(present_time-node->get_insertion_time());
+      nodes.append('\t');
+      nodes.append(node->get_identifier());
+      nodes.append('\n');
+
+      /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+      /* 2) Write the edge to the parent   */
+      /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+      if (!node->get_previous()->is_master_root())
+      {
+        edges.append("0\t1\t", 4);
+        edges.append(rows[node->get_previous()->get_position()]);
+        edges.append('\t');
+        edges.append(n);
+        edges.append('\n');
+      }
+      n++;
+    }
   }
-  return NULL;
+  node_file.close();
+  edge_file.close();
 }
 
 /**
- * \brief    Get the first node of the map
- * \details  Returns NULL if the node map is empty
- * \param    void
- * \return   \e puu_node*
+ * \brief    Writes the nodes of the tree as a table
+ * \details  Writes one line per node (except the master root), in identifier
+ *           (i.e. time) order, through a 1MB buffer. Columns are separated by
+ *           spaces: the insertion time under 'time_header', then the value of
+ *           each extractor applied to the selection unit under its name
+ *           ("NA" if the node has no selection unit).
+ * \param    std::string filename
+ * \param    std::string time_header
+ * \param    const std::vector< std::pair<std::string, std::function<double(const selection_unit&)> > >& columns
+ * \return   \e void
  */
 template <typename selection_unit>
-inline puu_node<selection_unit>* puu_tree<selection_unit>::get_first( void )
+void puu_tree<selection_unit>::write_lineage_table( std::string filename, std::string time_header, const std::vector< std::pair<std::string, std::function<double(const selection_unit&)> > >& columns )
 {
-  _iterator = _node_map.begin();
-  if (_iterator == _node_map.end())
-  {
-    return NULL;
-  }
-  if (_iterator->second->is_master_root())
-  {
-    _iterator++;
-  }
-  if (_iterator == _node_map.end())
+  std::ofstream file(filename.c_str(), std::ios::out | std::ios::trunc);
   {
-    return NULL;;
+    puu_output_buffer output(file, 1048576);
+    output.set_precision(_output_precision);
+    write_lineage_header(output, time_header, columns);
+    for (size_t pos = 1; pos < _node_vector.size(); pos++)
+    {
+      if (_node_vector[pos] != NULL)
+      {
+        write_lineage_row(output, _node_vector[pos], columns);
+      }
+    }
   }
-  return _iterator->second;
+  file.close();
 }
 
 /**
- * \brief    Get the next node
- * \details  Returns NULL if the end of the node map is reached
- * \param    void
- * \return   \e puu_node*
+ * \brief    Writes the line of descent of a selection unit as a table
+ * \details  Writes the ancestors of the node of 'unit' up to its root, from
+ *           the oldest, with the same columns as write_lineage_table()
+ * \param    std::string filename
+ * \param    selection_unit* unit
+ * \param    std::string time_header
+ * \param    const std::vector< std::pair<std::string, std::function<double(const selection_unit&)> > >& columns
+ * \return   \e void
  */
 template <typename selection_unit>
-inline puu_node<selection_unit>* puu_tree<selection_unit>::get_next( void )
+void puu_tree<selection_unit>::write_line_of_descent( std::string filename, selection_unit* unit, std::string time_header, const std::vector< std::pair<std::string, std::function<double(const selection_unit&)> > >& columns )
 {
-  _iterator++;
-  if (_iterator == _node_map.end())
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 1) Collect the line of descent    */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  puu_node<selection_unit>* node = get_node_by_selection_unit(unit);
+  if (node == NULL)
   {
-    return NULL;
+    printf("Error in puu_tree::write_line_of_descent(): the selection unit is not in the tree. Exit.\n");
+    exit(EXIT_FAILURE);
   }
-  if (_iterator->second->is_master_root())
+  std::vector<puu_node<selection_unit>*> line;
+  while (node != NULL)
   {
-    _iterator++;
+    line.push_back(node);
+    node = node->get_parent();
   }
-  if (_iterator == _node_map.end())
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 2) Write it from the oldest node  */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  std::ofstream file(filename.c_str(), std::ios::out | std::ios::trunc);
   {
-    return NULL;
+    puu_output_buffer output(file, 1048576);
+    output.set_precision(_output_precision);
+    write_lineage_header(output, time_header, columns);
+    for (size_t i = line.size(); i > 0; i--)
+    {
+      write_lineage_row(output, line[i-1], columns);
+    }
   }
-  return _iterator->second;
+  file.close();
 }
 
 /**
- * \brief    Get the list of active node identifiers
- * \details  --
- * \param    std::vector<unsigned long long int>* active_node_identifiers
+ * \brief    Saves the tree in a checkpoint file
+ * \details  Nodes are written in a single pass, in identifier order, with
+ *           their position among the children of their parent. The
+ *           selection units copied by inactive nodes are written with the
+ *           serializer, in the same stream. Active nodes are recorded by the
+ *           position of their selection unit in 'active_units', which must
+ *           contain the selection units of all active nodes. Projections
+ *           are written as is, and shared snapshots are written once. Delta
+ *           snapshots are written as full copies. The tree is restored with
+ *           load_checkpoint().
+ * \param    std::string filename
+ * \param    const std::vector<selection_unit*>& active_units
+ * \param    std::function<void(const selection_unit&, std::ostream&)> serializer
  * \return   \e void
  */
 template <typename selection_unit>
-inline void puu_tree<selection_unit>::get_active_node_identifiers( std::vector<unsigned long long int>* active_node_identifiers )
+void puu_tree<selection_unit>::save_checkpoint( std::string filename, const std::vector<selection_unit*>& active_units, std::function<void(const selection_unit&, std::ostream&)> serializer )
 {
-  active_node_identifiers->clear();
-  for (_iterator = _node_map.begin(); _iterator != _node_map.end(); ++_iterator)
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 1) Index active selection units   */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  std::unordered_map<selection_unit*, unsigned long long int>               active_positions;
+  std::unordered_map<puu_snapshot<selection_unit>*, unsigned long long int> shared_snapshots;
+  active_positions.reserve(active_units.size());
+  for (size_t i = 0; i < active_units.size(); i++)
   {
-    if (_iterator->second->is_active())
-    {
-      active_node_identifiers->push_back(_iterator->second->get_identifier());
-    }
+    active_positions[active_units[i]] = i;
+  }
 
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 2) Write the header               */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  std::vector<char> stream_buffer(1048576);
+  std::ofstream     file;
+  file.rdbuf()->pubsetbuf(&stream_buffer[0], (std::streamsize)stream_buffer.size());
+  file.open(filename.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+  if (!file)
+  {
+    printf("Error in puu_tree::save_checkpoint(): cannot write file %s. Exit.\n", filename.c_str());
+    exit(EXIT_FAILURE);
   }
-}
+  unsigned int           version         = 2;
+  unsigned int           byte_order      = 0x01020304;
+  unsigned int           update_mode     = (unsigned int)_update_mode;
+  unsigned int           record_size     = (unsigned int)_projections.get_record_size();
+  unsigned long long int number_of_nodes = (unsigned long long int)_number_of_nodes-1;
+  unsigned long long int number_of_units = (unsigned long long int)active_units.size();
+  file.write("PUUCKPT", 8);
+  file.write((const char*)&version, 4);
+  file.write((const char*)&byte_order, 4);
+  file.write((const char*)&_current_id, 8);
+  file.write((const char*)&update_mode, 4);
+  file.write((const char*)&record_size, 4);
+  file.write((const char*)&number_of_nodes, 8);
+  file.write((const char*)&number_of_units, 8);
 
-/**
- * \brief    Get the common ancestor
- * \details  Returns NULL if the population is extincted or if the tree is multi-rooted
- * \param    void
- * \return   \e puu_node*
- */
-template <typename selection_unit>
-inline puu_node<selection_unit>* puu_tree<selection_unit>::get_common_ancestor( void )
-{
-  puu_node<selection_unit>* master_root = _node_map[0];
-  if (master_root->get_number_of_children() == 1)
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 3) Write the nodes                */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  size_t                 number_of_active_nodes = 0;
+  unsigned long long int shared_snapshots_owner = 0;
+  for (size_t pos = 1; pos < _node_vector.size(); pos++)
+  {
+    puu_node<selection_unit>* node = _node_vector[pos];
+    if (node == NULL)
+    {
+      continue;
+    }
+    unsigned long long int        identifier        = node->get_identifier();
+    unsigned long long int        parent_identifier = node->get_previous()->get_identifier();
+    unsigned int                  child_index       = (unsigned int)node->get_child_index();
+    double                        time              = node->get_insertion_time();
+    char                          node_class        = (char)node->get_node_class();
+    const void*                   record            = _projections.get_record(node->get_slot());
+    puu_snapshot<selection_unit>* snapshot          = node->get_snapshot();
+    char                          state             = (node->is_active() ? 2 : (snapshot != NULL ? 1 : (record != NULL ? 3 : 0)));
+    if (snapshot != NULL && snapshot->get_number_of_references() > 1)
+    {
+      typename std::unordered_map<puu_snapshot<selection_unit>*, unsigned long long int>::iterator it = shared_snapshots.find(snapshot);
+      if (it == shared_snapshots.end())
+      {
+        shared_snapshots[snapshot] = identifier;
+      }
+      else
+      {
+        state                  = 4;
+        shared_snapshots_owner = it->second;
+      }
+    }
+    file.write((const char*)&identifier, 8);
+    file.write((const char*)&parent_identifier, 8);
+    file.write((const char*)&child_index, 4);
+    file.write((const char*)&time, 8);
+    file.write(&node_class, 1);
+    file.write(&state, 1);
+    if (state == 2)
+    {
+      typename std::unordered_map<selection_unit*, unsigned long long int>::iterator it = active_positions.find(node->get_selection_unit());
+      if (it == active_positions.end())
+      {
+        printf("Error in puu_tree::save_checkpoint(): the selection unit of node %llu is missing from active units. Exit.\n", identifier);
+        exit(EXIT_FAILURE);
+      }
+      file.write((const char*)&it->second, 8);
+      number_of_active_nodes++;
+    }
+    else if (state == 1)
+    {
+      unsigned long long int hash = (unsigned long long int)snapshot->get_hash();
+      file.write((const char*)&hash, 8);
+      serializer(*snapshot->get_unit(), file);
+    }
+    else if (state == 3)
+    {
+      file.write((const char*)record, record_size);
+    }
+    else if (state == 4)
+    {
+      file.write((const char*)&shared_snapshots_owner, 8);
+    }
+  }
+  if (number_of_active_nodes != active_units.size())
   {
-    return master_root->get_child(0);
+    printf("Error in puu_tree::save_checkpoint(): active units do not match active nodes. Exit.\n");
+    exit(EXIT_FAILURE);
   }
-  return NULL;
+  file.close();
 }
 
 /**
- * \brief    Get the common ancestor age
- * \details  If the root is multi-rooted, returns the mean of root ages
- * \param    void
- * \return   \e double
+ * \brief    Restores the tree from a checkpoint file
+ * \details  The tree must be empty, with the same projection as when saving,
+ *           if any. Identifiers, structure, projections and copied
+ *           selection units (read with the deserializer) are restored, as
+ *           well as the order of children (from version 2 files), and
+ *           active nodes are bound to the selection units of 'active_units',
+ *           given in the same order as when saving. Node handles are not
+ *           preserved: the new handles of active nodes are returned in the
+ *           order of 'active_units'.
+ * \param    std::string filename
+ * \param    const std::vector<selection_unit*>& active_units
+ * \param    std::function<selection_unit*(std::istream&)> deserializer
+ * \return   \e std::vector<puu_handle>
  */
 template <typename selection_unit>
-inline double puu_tree<selection_unit>::get_common_ancestor_age( void )
+std::vector<puu_handle> puu_tree<selection_unit>::load_checkpoint( std::string filename, const std::vector<selection_unit*>& active_units, std::function<selection_unit*(std::istream&)> deserializer )
 {
-  puu_node<selection_unit>* master_root = _node_map[0];
+  if (_number_of_nodes != 1)
+  {
+    printf("Error in puu_tree::load_checkpoint(): the tree is not empty. Exit.\n");
+    exit(EXIT_FAILURE);
+  }
 
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  /* 1) If the population went extincte        */
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  if(master_root->get_number_of_children() == 0)
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 1) Read the header                */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  std::vector<char> stream_buffer(1048576);
+  std::ifstream     file;
+  file.rdbuf()->pubsetbuf(&stream_buffer[0], (std::streamsize)stream_buffer.size());
+  file.open(filename.c_str(), std::ios::in | std::ios::binary);
+  char                   magic[8];
+  unsigned int           version         = 0;
+  unsigned int           byte_order      = 0;
+  unsigned long long int current_id      = 0;
+  unsigned int           update_mode     = 0;
+  unsigned int           record_size     = 0;
+  unsigned long long int number_of_nodes = 0;
+  unsigned long long int number_of_units = 0;
+  file.read(magic, 8);
+  file.read((char*)&version, 4);
+  file.read((char*)&byte_order, 4);
+  file.read((char*)&current_id, 8);
+  file.read((char*)&update_mode, 4);
+  file.read((char*)&record_size, 4);
+  file.read((char*)&number_of_nodes, 8);
+  file.read((char*)&number_of_units, 8);
+  if (!file || memcmp(magic, "PUUCKPT", 8) != 0 || version < 1 || version > 2 || byte_order != 0x01020304)
   {
-    return 0.0;
+    printf("Error in puu_tree::load_checkpoint(): %s is not a valid checkpoint file. Exit.\n", filename.c_str());
+    exit(EXIT_FAILURE);
+  }
+  if (record_size != 0 && record_size != _projections.get_record_size())
+  {
+    printf("Error in puu_tree::load_checkpoint(): projections of %u bytes must be set before loading. Exit.\n", record_size);
+    exit(EXIT_FAILURE);
+  }
+  if (number_of_units != active_units.size())
+  {
+    printf("Error in puu_tree::load_checkpoint(): %llu active units were expected. Exit.\n", number_of_units);
+    exit(EXIT_FAILURE);
   }
+  _current_id  = current_id;
+  _update_mode = (puu_update_mode)update_mode;
+  reserve((size_t)number_of_nodes);
 
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  /* 2) If there is a unique common ancestor   */
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  else if (master_root->get_number_of_children() == 1)
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 2) Read the nodes                 */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  typedef std::tuple<unsigned long long int, unsigned long long int, puu_node<selection_unit>*, puu_node<selection_unit>*> link;
+  std::vector<puu_handle> active_handles(active_units.size());
+  std::vector<char>       record;
+  std::vector<link>       links;
+  links.reserve((size_t)number_of_nodes);
+  for (unsigned long long int i = 0; i < number_of_nodes; i++)
   {
-    if (master_root->get_child(0)->is_active())
+    unsigned long long int        identifier        = 0;
+    unsigned long long int        parent_identifier = 0;
+    unsigned int                  child_position    = 0;
+    double                        time              = 0.0;
+    char                          node_class        = 0;
+    char                          state             = 0;
+    unsigned long long int        unit_position     = 0;
+    unsigned long long int        hash              = 0;
+    selection_unit*               unit              = NULL;
+    puu_snapshot<selection_unit>* snapshot          = NULL;
+    file.read((char*)&identifier, 8);
+    file.read((char*)&parent_identifier, 8);
+    if (version >= 2)
+    {
+      file.read((char*)&child_position, 4);
+    }
+    file.read((char*)&time, 8);
+    file.read(&node_class, 1);
+    file.read(&state, 1);
+    if (state == 2)
+    {
+      file.read((char*)&unit_position, 8);
+      unit = (unit_position < active_units.size() ? active_units[unit_position] : NULL);
+    }
+    else if (state == 1)
+    {
+      file.read((char*)&hash, 8);
+      selection_unit* copy = deserializer(file);
+      snapshot             = (copy != NULL ? new puu_snapshot<selection_unit>(copy, (size_t)hash) : NULL);
+    }
+    else if (state == 3)
+    {
+      record.resize(record_size);
+      file.read(&record[0], record_size);
+    }
+    else if (state == 4)
+    {
+      unsigned long long int owner_identifier = 0;
+      file.read((char*)&owner_identifier, 8);
+      puu_node<selection_unit>* owner = get_node_by_identifier(owner_identifier);
+      snapshot                        = (owner != NULL ? owner->get_snapshot() : NULL);
+    }
+    puu_node<selection_unit>* parent = get_node_by_identifier(parent_identifier);
+    if (!file || parent == NULL || (state == 2 && unit == NULL) || ((state == 1 || state == 4) && snapshot == NULL))
+    {
+      printf("Error in puu_tree::load_checkpoint(): cannot read node %llu. Exit.\n", identifier);
+      exit(EXIT_FAILURE);
+    }
+
+    /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+    /* 3) Rebuild the node               */
+    /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+    puu_node<selection_unit>* node = _pool.create_node(identifier);
+    node->restore(time, unit, snapshot);
+    if (state == 1 && _snapshot_store != NULL)
+    {
+      _snapshot_store->store(snapshot);
+    }
+    if (state == 3)
+    {
+      memcpy(_projections.create_record(node->get_slot()), &record[0], record_size);
+    }
+    if ((puu_node_class)node_class == ROOT)
     {
-      return (double)master_root->get_child(0)->get_insertion_time();
+      node->as_root();
     }
     else
     {
-      return (double)master_root->get_child(0)->get_insertion_time();
+      node->as_normal();
+    }
+    links.push_back(std::make_tuple(parent_identifier, (version >= 2 ? (unsigned long long int)child_position : i), parent, node));
+    store_node(node);
+    if (state == 2)
+    {
+      active_handles[unit_position] = get_handle(node);
+      if (_map_units)
+      {
+        _unit_map[unit] = node;
+      }
     }
   }
+  file.close();
 
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  /* 3) If there are multiple common ancestors */
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  else
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 4) Attach children in their order */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  std::sort(links.begin(), links.end());
+  for (size_t i = 0; i < links.size(); i++)
   {
-    double mean = 0.0;
-    for (size_t i = 0; i < master_root->get_number_of_children(); i++)
+    std::get<3>(links[i])->set_parent(std::get<2>(links[i]));
+    std::get<2>(links[i])->add_child(std::get<3>(links[i]));
+  }
+  track_common_ancestor();
+  return active_handles;
+}
+
+/*----------------------------
+ * PROTECTED METHODS
+ *----------------------------*/
+
+/**
+ * \brief    Prunes the tree
+ * \details  Removes all dead branches. Tagging and the search for untagged
+ *           nodes are split between threads, by contiguous ranges of the node
+ *           vector. The list of nodes to delete is built in the node vector
+ *           order whatever the number of threads.
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_tree<selection_unit>::prune()
+{
+  bool concurrent = (_number_of_threads > 1);
+  std::vector< std::vector<puu_node<selection_unit>*> > remove_lists(_number_of_threads);
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 1) Untag the tree                   */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  run_in_parallel([this]( size_t first, size_t last, size_t )
+  {
+    for (size_t i = first; i < last; i++)
     {
-      if (master_root->get_child(0)->is_active())
+      if (_node_vector[i] != NULL)
       {
-        mean += (double)master_root->get_child(0)->get_insertion_time();
+        _node_vector[i]->untag();
       }
-      else
+    }
+  });
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 2) Tag alive cells lineage          */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  run_in_parallel([this, concurrent]( size_t first, size_t last, size_t )
+  {
+    for (size_t i = first; i < last; i++)
+    {
+      if (_node_vector[i] != NULL && _node_vector[i]->is_active())
+      {
+        if (concurrent)
+        {
+          _node_vector[i]->tag_lineage_concurrently();
+        }
+        else
+        {
+          _node_vector[i]->tag_lineage();
+        }
+      }
+    }
+  });
+
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 3) Build the list of untagged nodes */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  run_in_parallel([this, &remove_lists]( size_t first, size_t last, size_t thread )
+  {
+    for (size_t i = first; i < last; i++)
+    {
+      if (_node_vector[i] != NULL && !_node_vector[i]->is_tagged() && !_node_vector[i]->is_master_root())
       {
-        mean += (double)master_root->get_child(0)->get_insertion_time();
+        remove_lists[thread].push_back(_node_vector[i]);
       }
     }
-    return mean/master_root->get_number_of_children();
-  }
-}
+  });
 
-/*----------------------------
- * SETTERS
- *----------------------------*/
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 4) Delete untagged nodes            */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  for (size_t thread = 0; thread < remove_lists.size(); thread++)
+  {
+    for (size_t i = 0; i < remove_lists[thread].size(); i++)
+    {
+      delete_node(remove_lists[thread][i]);
+    }
+    remove_lists[thread].clear();
+  }
 
-/*----------------------------
- * CONSTRUCTORS
- *----------------------------*/
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 5) Set master root children as root */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  puu_node<selection_unit>* master_root = _node_vector[0];
+  for (size_t i = 0; i < master_root->get_number_of_children(); i++)
+  {
+    master_root->get_child(i)->as_root();
+  }
+}
 
 /**
- * \brief    Default constructor
- * \details  The tree is initialized with one node called the master root
+ * \brief    Shortens the tree
+ * \details  Removes all the dead nodes that are not common ancestors
  * \param    void
  * \return   \e void
  */
 template <typename selection_unit>
-puu_tree<selection_unit>::puu_tree( void )
+void puu_tree<selection_unit>::shorten()
 {
-  _current_id = 0;
-  _node_map.clear();
-  _iterator = _node_map.begin();
-  puu_node<selection_unit>* master_root = new puu_node<selection_unit>(_current_id);
-  _node_map[_current_id] = master_root;
-}
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 1) Select all intermediate nodes:   */
+  /*    - not master root                */
+  /*    - not alive                      */
+  /*    - possessing exactly one child   */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  std::vector<puu_node<selection_unit>*> remove_list;
+  remove_list.clear();
+  for (size_t i = 0; i < _node_vector.size(); i++)
+  {
+    puu_node<selection_unit>* node = _node_vector[i];
+    if (node != NULL && !node->is_master_root() && !node->is_active() && node->get_number_of_children() == 1)
+    {
+      remove_list.push_back(node);
+    }
+  }
 
-/*----------------------------
- * DESTRUCTORS
- *----------------------------*/
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 2) Delete nodes                     */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  for (size_t i = 0; i < remove_list.size(); i++)
+  {
+    delete_node(remove_list[i]);
+  }
+  remove_list.clear();
+
+#if DEBUG
+  for (size_t i = 0; i < _node_vector.size(); i++)
+  {
+    if (_node_vector[i] != NULL && !_node_vector[i]->is_master_root() && !_node_vector[i]->is_active())
+    {
+      assert(_node_vector[i]->get_number_of_children() >= 2);
+    }
+  }
+#endif
 
-/**
- * \brief    Destructor
- * \details  --
- * \param    void
- * \return   \e void
- */
-template <typename selection_unit>
-puu_tree<selection_unit>::~puu_tree( void )
-{
-  _iterator = _node_map.begin();
-  for (_iterator = _node_map.begin(); _iterator != _node_map.end(); ++_iterator)
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 3) Set master root children as root */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  puu_node<selection_unit>* master_root = _node_vector[0];
+  for (size_t i = 0; i < master_root->get_number_of_children(); i++)
   {
-    delete _iterator->second;
-    _iterator->second = NULL;
+    master_root->get_child(i)->as_root();
   }
-  _node_map.clear();
-  _unit_map.clear();
 }
 
-/*----------------------------
- * PUBLIC METHODS
- *----------------------------*/
-
 /**
- * \brief    Adds a root to the tree
- * \details  --
- * \param    selection_unit* unit
+ * \brief    Runs a task over the node vector with all the threads
+ * \details  The node vector is split into one contiguous range per thread.
+ *           The task receives the range [first, last) and the thread index.
+ *           With a single thread, the task runs in the calling thread.
+ * \param    const std::function<void(size_t, size_t, size_t)>& task
  * \return   \e void
  */
 template <typename selection_unit>
-void puu_tree<selection_unit>::add_root( selection_unit* unit )
+void puu_tree<selection_unit>::run_in_parallel( const std::function<void(size_t, size_t, size_t)>& task )
 {
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  /* 1) Get the master root          */
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  puu_node<selection_unit>* master_root = _node_map[0];
-
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  /* 2) Create the root              */
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  _current_id++;
-  puu_node<selection_unit>* root = new puu_node<selection_unit>(_current_id, 0.0, unit);
-
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  /* 3) Connect nodes                */
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  root->as_root();
-  root->set_parent(master_root);
-  master_root->add_child(root);
-
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  /* 4) Add the root to the node map */
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  assert(_node_map.find(root->get_identifier()) == _node_map.end());
-  _node_map[root->get_identifier()] = root;
-
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  /* 5) Add the root to the unit map */
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  assert(_unit_map.find(unit) == _unit_map.end());
-  _unit_map[unit] = root;
+  size_t size = _node_vector.size();
+  if (_number_of_threads == 1)
+  {
+    task(0, size, 0);
+    return;
+  }
+  size_t                   chunk = (size+_number_of_threads-1)/_number_of_threads;
+  std::vector<std::thread> threads;
+  threads.reserve(_number_of_threads);
+  for (size_t thread = 0; thread < _number_of_threads; thread++)
+  {
+    size_t first = std::min(size, thread*chunk);
+    size_t last  = std::min(size, first+chunk);
+    threads.push_back(std::thread(task, first, last, thread));
+  }
+  for (size_t thread = 0; thread < threads.size(); thread++)
+  {
+    threads[thread].join();
+  }
 }
 
 /**
- * \brief    Adds a reproduction event to the tree
+ * \brief    Creates a new active node and attaches it to its parental node
  * \details  --
- * \param    selection_unit* parent
+ * \param    puu_node* parent_node
  * \param    selection_unit* child
  * \param    double time
- * \return   \e void
+ * \return   \e puu_node*
  */
 template <typename selection_unit>
-void puu_tree<selection_unit>::add_reproduction_event( selection_unit* parent, selection_unit* child, double time )
+puu_node<selection_unit>* puu_tree<selection_unit>::create_child_node( puu_node<selection_unit>* parent_node, selection_unit* child, double time )
 {
-  assert(time >= 0.0);
-
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  /* 1) Get parental node              */
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  assert(_unit_map.find(parent) != _unit_map.end());
-  puu_node<selection_unit>* parent_node = _unit_map[parent];
+  assert(parent_node->is_active());
 
   /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  /* 2) Create child node              */
+  /* 1) Create child node              */
   /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
   _current_id++;
-  puu_node<selection_unit>* child_node = new puu_node<selection_unit>(_current_id, time, child);
+  puu_node<selection_unit>* child_node = _pool.create_node(_current_id, time, child);
 
   /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  /* 3) Update child node attributes   */
+  /* 2) Update child node attributes   */
   /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
   child_node->set_parent(parent_node);
   parent_node->add_child(child_node);
 
   /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  /* 4) Add child node to the node map */
+  /* 3) Add child node to the tree     */
   /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  assert(_node_map.find(_current_id) == _node_map.end());
-  _node_map[child_node->get_identifier()] = child_node;
+  store_node(child_node);
 
   /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  /* 5) Add child node to the unit map */
+  /* 4) Add child node to the unit map */
   /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  assert(_unit_map.find(child) == _unit_map.end());
-  _unit_map[child] = child_node;
+  if (_map_units)
+  {
+    assert(_unit_map.find(child) == _unit_map.end());
+    _unit_map[child] = child_node;
+  }
+  return child_node;
 }
 
 /**
- * \brief    Inactivates the node belonging to the provided selection unit
- * \details  If copy_unit is set to true, a local copy of the selection unit is made
- * \param    selection_unit* unit
+ * \brief    Inactivates a node
+ * \details  With live updates, a node which does not belong to the tree
+ *           anymore is removed immediately (no copy is made in this case).
+ *           With projections, the projection is stored instead of a copy,
+ *           and with snapshot sharing, the copy may be shared.
+ * \param    puu_node* node
  * \param    bool copy_unit
  * \return   \e void
  */
 template <typename selection_unit>
-void puu_tree<selection_unit>::inactivate( selection_unit* unit, bool copy_unit )
+void puu_tree<selection_unit>::inactivate_node( puu_node<selection_unit>* node, bool copy_unit )
 {
-  assert(_unit_map.find(unit) != _unit_map.end());
-  puu_node<selection_unit>* node = _unit_map[unit];
-  _unit_map.erase(unit);
-  node->inactivate(copy_unit);
+  assert(node->is_active());
+  bool extinct   = (_update_mode != DEFERRED_UPDATES && node->get_number_of_children() == 0);
+  bool coalesced = (_update_mode == LIVE_COALESCENCE && node->get_number_of_children() == 1);
+  if (extinct || coalesced)
+  {
+    /* live_update() deletes the node */
+    node->inactivate(false);
+    live_update(node);
+  }
+  else
+  {
+    inactivate_kept_node(node, copy_unit);
+  }
+  track_common_ancestor();
 }
 
 /**
- * \brief    Update the tree as a lineage tree
- * \details  Prune dead branches.
- * \param    void
+ * \brief    Inactivates a node which stays in the tree
+ * \details  Stores the projection or the copy of the selection unit, if
+ *           asked. The common ancestor is not updated.
+ * \param    puu_node* node
+ * \param    bool copy_unit
  * \return   \e void
  */
 template <typename selection_unit>
-void puu_tree<selection_unit>::update_as_lineage_tree( void )
+void puu_tree<selection_unit>::inactivate_kept_node( puu_node<selection_unit>* node, bool copy_unit )
 {
-  prune();
+  assert(node->is_active());
+  if (copy_unit && _projections.is_enabled())
+  {
+    _projector(*node->get_selection_unit(), _projections.create_record(node->get_slot()));
+    node->inactivate(false);
+  }
+  else if (copy_unit && (_snapshot_hash || _delta_codec != NULL))
+  {
+    node->inactivate_with_snapshot(share_snapshot(node));
+  }
+  else
+  {
+    node->inactivate(copy_unit);
+  }
+  if (_snapshot_store != NULL && node->get_snapshot() != NULL)
+  {
+    _snapshot_store->store(node->get_snapshot());
+  }
 }
 
 /**
- * \brief    Update the tree as a coalescence tree
- * \details  Prune dead branches and shorten the tree.
- * \param    void
- * \return   \e void
+ * \brief    Get the snapshot of an active node about to be inactivated
+ * \details  With snapshot sharing, the snapshot of the parental node is
+ *           reused if it holds an equal selection unit. Else, a new snapshot
+ *           is created, as a delta of the parental snapshot if deltas are set.
+ * \param    puu_node* node
+ * \return   \e puu_snapshot*
  */
 template <typename selection_unit>
-void puu_tree<selection_unit>::update_as_coalescence_tree( void )
+puu_snapshot<selection_unit>* puu_tree<selection_unit>::share_snapshot( puu_node<selection_unit>* node )
 {
-  prune();
-  shorten();
+  selection_unit*               unit     = node->get_selection_unit();
+  size_t                        hash     = (_snapshot_hash ? _snapshot_hash(*unit) : 0);
+  puu_snapshot<selection_unit>* snapshot = node->get_previous()->get_snapshot();
+  if (_snapshot_hash && snapshot != NULL && snapshot->get_hash() == hash && _snapshot_equal(*snapshot->get_unit(), *unit))
+  {
+    return snapshot;
+  }
+  if (_delta_codec != NULL)
+  {
+    return _delta_codec->encode(snapshot, *unit, hash);
+  }
+  return new puu_snapshot<selection_unit>(new selection_unit(*unit), hash);
 }
 
 /**
- * \brief    Writes tree in a text file
- * \details  Writes adjacency list in a file (.txt).
- * \param    std::string filename
+ * \brief    Sizes the tree storage for the given number of new nodes
+ * \details  Vectors are grown geometrically to keep insertions amortized
+ * \param    size_t number_of_new_nodes
  * \return   \e void
  */
 template <typename selection_unit>
-void puu_tree<selection_unit>::write_tree( std::string filename )
+void puu_tree<selection_unit>::reserve( size_t number_of_new_nodes )
 {
-  std::ofstream file(filename.c_str(), std::ios::out | std::ios::trunc);
-  for (_iterator = _node_map.begin(); _iterator != _node_map.end(); ++_iterator)
+  size_t capacity = _node_vector.size()+number_of_new_nodes;
+  if (_node_vector.capacity() < capacity)
   {
-    for (size_t i = 0; i < _iterator->second->get_number_of_children(); i++)
-    {
-      file << _iterator->second->get_id() << " " << _iterator->second->get_child(i)->get_id() << "\n";
-    }
+    capacity = std::max(capacity, 2*_node_vector.capacity());
+    _node_vector.reserve(capacity);
+    _identifier_vector.reserve(capacity);
+  }
+  _pool.reserve(_pool.get_number_of_nodes()+number_of_new_nodes);
+  if (_map_units)
+  {
+    _unit_map.reserve(_unit_map.size()+number_of_new_nodes);
   }
-  file.close();
 }
 
 /**
- * \brief    Writes Newick tree
- * \details  Writes tree in Newick format in a file (.phb)
- * \param    std::string filename
+ * \brief    Adds a node at the end of the node vector
+ * \details  Identifiers being increasing, the node vector remains sorted
+ * \param    puu_node* node
  * \return   \e void
  */
 template <typename selection_unit>
-void puu_tree<selection_unit>::write_newick_tree( std::string filename )
+void puu_tree<selection_unit>::store_node( puu_node<selection_unit>* node )
 {
-  std::ofstream file(filename.c_str(), std::ios::out | std::ios::trunc);
-
-  for (size_t i = 0; i < _node_map[0]->get_number_of_children(); i++)
-  {
-    std::stringstream newick_tree;
-    inOrderNewick(_node_map[0]->get_child(i), 0, newick_tree);
-    newick_tree << ";\n";
-    file << newick_tree.str();
-  }
-  file.close();
+  assert(_identifier_vector.empty() || _identifier_vector.back() < node->get_identifier());
+  node->set_position(_node_vector.size());
+  _node_vector.push_back(node);
+  _identifier_vector.push_back(node->get_identifier());
+  _number_of_nodes++;
+  _ancestry_dirty = true;
+  _lca_dirty      = true;
 }
 
-/*----------------------------
- * PROTECTED METHODS
- *----------------------------*/
-
 /**
- * \brief    Prunes the tree
- * \details  Removes all dead branches.
- * \param    void
+ * \brief    Deletes a node and removes all node's relationships
+ * \details  The node vector is compacted once half of its entries are empty
+ * \param    puu_node* node
  * \return   \e void
  */
 template <typename selection_unit>
-void puu_tree<selection_unit>::prune()
+void puu_tree<selection_unit>::delete_node( puu_node<selection_unit>* node )
 {
-  untag_tree();
+  assert(node != NULL);
+  assert(_node_vector[node->get_position()] == node);
+  assert(!node->is_active());
 
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  /* 1) Tag alive cells lineage          */
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  for (_iterator = _node_map.begin(); _iterator != _node_map.end(); ++_iterator)
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 1) Update parental children list  */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  puu_node<selection_unit>* parent = node->get_previous();
+  parent->replace_by_grandchildren(node);
+  if (node == _mrca)
   {
-    assert(_iterator->first == _iterator->second->get_identifier());
-    if (_iterator->second->is_active())
-    {
-      _iterator->second->tag_lineage();
-    }
+    _mrca = (parent->is_master_root() ? NULL : parent);
   }
 
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  /* 2) Build the list of untagged nodes */
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  std::vector<unsigned long long int> remove_list;
-  for (_iterator = _node_map.begin(); _iterator != _node_map.end(); ++_iterator)
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 2) Children may have become roots */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  if (parent->is_master_root())
   {
-    if (!_iterator->second->is_tagged() && !_iterator->second->is_master_root())
+    for (size_t i = 0; i < node->get_number_of_children(); i++)
     {
-      remove_list.push_back(_iterator->first);
+      node->get_child(i)->as_root();
     }
   }
 
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  /* 3) Delete untagged nodes            */
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  for (size_t i = 0; i < remove_list.size(); i++)
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  /* 3) Delete node in the node vector */
+  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+  _node_vector[node->get_position()] = NULL;
+  _projections.erase_record(node->get_slot());
+  _pool.destroy_node(node);
+  _number_of_nodes--;
+  _ancestry_dirty = true;
+  _lca_dirty      = true;
+  _number_of_holes++;
+  if (_number_of_holes > _number_of_nodes)
   {
-    delete_node(remove_list[i]);
+    compact_node_vector();
   }
-  remove_list.clear();
+}
 
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  /* 4) Set master root children as root */
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  puu_node<selection_unit>* master_root = _node_map[0];
-  for (size_t i = 0; i < master_root->get_number_of_children(); i++)
+/**
+ * \brief    Writes the header of a lineage table
+ * \details  --
+ * \param    puu_output_buffer& output
+ * \param    const std::string& time_header
+ * \param    const std::vector< std::pair<std::string, std::function<double(const selection_unit&)> > >& columns
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_tree<selection_unit>::write_lineage_header( puu_output_buffer& output, const std::string& time_header, const std::vector< std::pair<std::string, std::function<double(const selection_unit&)> > >& columns )
+{
+  output.append(time_header.c_str(), time_header.size());
+  for (size_t i = 0; i < columns.size(); i++)
   {
-    master_root->get_child(i)->as_root();
+    output.append(' ');
+    output.append(columns[i].first.c_str(), columns[i].first.size());
   }
+  output.append('\n');
 }
 
 /**
- * \brief    Shortens the tree
- * \details  Removes all the dead nodes that are not common ancestors
- * \param    void
+ * \brief    Writes the line of a node in a lineage table
+ * \details  --
+ * \param    puu_output_buffer& output
+ * \param    puu_node* node
+ * \param    const std::vector< std::pair<std::string, std::function<double(const selection_unit&)> > >& columns
  * \return   \e void
  */
 template <typename selection_unit>
-void puu_tree<selection_unit>::shorten()
+void puu_tree<selection_unit>::write_lineage_row( puu_output_buffer& output, puu_node<selection_unit>* node, const std::vector< std::pair<std::string, std::function<double(const selection_unit&)> > >& columns )
 {
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  /* 1) Select all intermediate nodes:   */
-  /*    - not master root                */
-  /*    - not alive                      */
-  /*    - possessing exactly one child   */
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  std::vector<unsigned long long int> remove_list;
-  remove_list.clear();
-  for (_iterator = _node_map.begin(); _iterator != _node_map.end(); ++_iterator)
+  selection_unit* unit = node->get_selection_unit();
+  output.append(node->get_insertion_time());
+  for (size_t i = 0; i < columns.size(); i++)
   {
-    assert(_iterator->first == _iterator->second->get_identifier());
-    if (!_iterator->second->is_master_root() && !_iterator->second->is_active() && _iterator->second->get_number_of_children() == 1)
+    output.append(' ');
+    if (unit != NULL)
     {
-      remove_list.push_back(_iterator->first);
+      output.append(columns[i].second(*unit));
+    }
+    else
+    {
+      output.append("NA", 2);
     }
   }
+  output.append('\n');
+}
 
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  /* 2) Delete nodes                     */
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  for (size_t i = 0; i < remove_list.size(); i++)
+/**
+ * \brief    Moves the most recent common ancestor down the tree
+ * \details  The common ancestor only moves forward in time when nodes die,
+ *           so that the walk resumes from its last position, through
+ *           inactive nodes with a single child. The callback is called if it
+ *           reaches a new node.
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_tree<selection_unit>::track_common_ancestor( void )
+{
+  puu_node<selection_unit>* node = (_mrca != NULL ? _mrca : _node_vector[0]);
+  while (!node->is_active() && node->get_number_of_children() == 1)
   {
-    delete_node(remove_list[i]);
+    node = node->get_child(0);
   }
-  remove_list.clear();
-
-#if DEBUG
-  for (_iterator = _node_map.begin(); _iterator != _node_map.end(); ++_iterator)
+  if (node->is_master_root() || (!node->is_active() && node->get_number_of_children() == 0))
+  {
+    node = NULL;
+  }
+  _mrca = node;
+  if (_mrca != NULL && _mrca->get_identifier() != _mrca_identifier)
   {
-    if (!_iterator->second->is_master_root() && !_iterator->second->is_active())
+    _mrca_identifier = _mrca->get_identifier();
+    if (_mrca_callback)
     {
-      assert(_iterator->second->get_number_of_children() >= 2);
+      _mrca_callback(_mrca);
     }
   }
-#endif
+}
 
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  /* 3) Set master root children as root */
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  puu_node<selection_unit>* master_root = _node_map[0];
-  for (size_t i = 0; i < master_root->get_number_of_children(); i++)
+/**
+ * \brief    Appends the trunk above the common ancestor to the trunk file
+ * \details  Trunk nodes are written from the oldest and deleted. The first
+ *           one keeps its spilled parent as parental identifier.
+ * \param    void
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_tree<selection_unit>::spill_trunk( void )
+{
+  if (!_trunk_file.is_open() || _mrca == NULL)
   {
-    master_root->get_child(i)->as_root();
+    return;
+  }
+  size_t                    record_size = _projections.get_record_size();
+  puu_node<selection_unit>* node        = _node_vector[0]->get_child(0);
+  while (node != _mrca)
+  {
+    assert(!node->is_active());
+    assert(node->get_number_of_children() == 1);
+
+    /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+    /* 1) Write the node record          */
+    /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+    unsigned long long int        identifier        = node->get_identifier();
+    unsigned long long int        parent_identifier = _trunk_identifier;
+    unsigned int                  child_index       = (unsigned int)node->get_child_index();
+    double                        time              = node->get_insertion_time();
+    char                          node_class        = (char)(parent_identifier == 0 ? ROOT : NORMAL);
+    const void*                   record            = _projections.get_record(node->get_slot());
+    puu_snapshot<selection_unit>* snapshot          = node->get_snapshot();
+    char                          state             = (snapshot != NULL ? (snapshot == _trunk_snapshot ? 4 : 1) : (record != NULL ? 3 : 0));
+    _trunk_file.write((const char*)&identifier, 8);
+    _trunk_file.write((const char*)&parent_identifier, 8);
+    _trunk_file.write((const char*)&child_index, 4);
+    _trunk_file.write((const char*)&time, 8);
+    _trunk_file.write(&node_class, 1);
+    _trunk_file.write(&state, 1);
+    if (state == 1)
+    {
+      unsigned long long int hash = (unsigned long long int)snapshot->get_hash();
+      _trunk_file.write((const char*)&hash, 8);
+      _trunk_serializer(*snapshot->get_unit(), _trunk_file);
+    }
+    else if (state == 3)
+    {
+      _trunk_file.write((const char*)record, record_size);
+    }
+    else if (state == 4)
+    {
+      _trunk_file.write((const char*)&_trunk_owner, 8);
+    }
+
+    /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+    /* 2) Keep the last shared snapshot  */
+    /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+    if (snapshot != _trunk_snapshot)
+    {
+      if (snapshot != NULL)
+      {
+        snapshot->retain();
+      }
+      if (_trunk_snapshot != NULL)
+      {
+        _trunk_snapshot->release();
+      }
+      _trunk_snapshot = snapshot;
+      _trunk_owner    = identifier;
+    }
+    _trunk_identifier = identifier;
+
+    /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+    /* 3) Delete the node                */
+    /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+    puu_node<selection_unit>* child = node->get_child(0);
+    delete_node(node);
+    node = child;
   }
+  _trunk_file.flush();
 }
 
 /**
- * \brief    Deletes a node and removes all node's relationships
- * \details  --
- * \param    unsigned long long int node_identifier
+ * \brief    Updates the tree after the inactivation of a node
+ * \details  The number of children of a node is the number of its subtrees
+ *           still carrying active descendants. Going up the lineage, each
+ *           inactive node left without children is deleted. In a live
+ *           coalescence tree, the first surviving node is then removed if it
+ *           is inactive and left with a single child.
+ * \param    puu_node* node
  * \return   \e void
  */
 template <typename selection_unit>
-void puu_tree<selection_unit>::delete_node( unsigned long long int node_identifier )
+void puu_tree<selection_unit>::live_update( puu_node<selection_unit>* node )
 {
-  assert(_node_map.find(node_identifier) != _node_map.end());
-  puu_node<selection_unit>* node = _node_map[node_identifier];
-  assert(node->get_identifier() == node_identifier);
-  assert(!node->is_active());
-
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  /* 1) Update parental children list  */
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  node->get_previous()->replace_by_grandchildren(node);
-
   /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  /* 2) Set the new parent of children */
+  /* 1) Remove the extinct branch      */
   /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  for (size_t i = 0; i < node->get_previous()->get_number_of_children(); i++)
+  while (!node->is_master_root() && !node->is_active() && node->get_number_of_children() == 0)
   {
-    node->get_previous()->get_child(i)->set_parent(node->get_previous());
+    puu_node<selection_unit>* parent = node->get_previous();
+    delete_node(node);
+    node = parent;
   }
 
   /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  /* 3) Delete node in the node map    */
+  /* 2) Shorten the remaining lineage  */
   /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  delete _node_map[node_identifier];
-  _node_map[node_identifier] = NULL;
-  _node_map.erase(node_identifier);
+  if (_update_mode == LIVE_COALESCENCE && !node->is_master_root() && !node->is_active() && node->get_number_of_children() == 1)
+  {
+    delete_node(node);
+  }
 }
 
 /**
- * \brief    Recursive method used to build the Newick format file
- * \details  --
- * \param    puu_node* node
- * \param    double parent_time
- * \param    std::stringstream& output
+ * \brief    Removes the empty entries of the node vector
+ * \details  The relative order of nodes is preserved
+ * \param    void
  * \return   \e void
  */
 template <typename selection_unit>
-void puu_tree<selection_unit>::inOrderNewick( puu_node<selection_unit>* node, double parent_time, std::stringstream& output )
+void puu_tree<selection_unit>::compact_node_vector( void )
 {
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  /* 1) If node is a leaf                 */
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  if (node->is_active() || node->get_number_of_children() < 2)
+  size_t next = 0;
+  for (size_t i = 0; i < _node_vector.size(); i++)
   {
-    output << node->get_identifier() << ":" << node->get_insertion_time()-parent_time;
+    if (_node_vector[i] != NULL)
+    {
+      _node_vector[next]       = _node_vector[i];
+      _identifier_vector[next] = _identifier_vector[i];
+      _node_vector[next]->set_position(next);
+      next++;
+    }
   }
+  _node_vector.resize(next);
+  _identifier_vector.resize(next);
+  _number_of_holes = 0;
+}
 
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  /* 2) Else if node has several children */
-  /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-  else
+/**
+ * \brief    Writes the subtree of 'root' in Newick format
+ * \details  The traversal uses an explicit stack of (node, next child) pairs,
+ *           so that long lineages do not overflow the call stack. The stack
+ *           is provided by the caller to be reused between subtrees. In the
+ *           coalescence view, children are reached through their chain of
+ *           inactive nodes with a single child.
+ * \param    puu_node* root
+ * \param    std::vector< std::pair<puu_node*, size_t> >& stack
+ * \param    puu_output_buffer& output
+ * \param    bool coalescence_view
+ * \return   \e void
+ */
+template <typename selection_unit>
+void puu_tree<selection_unit>::inOrderNewick( puu_node<selection_unit>* root, std::vector< std::pair<puu_node<selection_unit>*, size_t> >& stack, puu_output_buffer& output, bool coalescence_view )
+{
+  stack.clear();
+  stack.push_back(std::make_pair(root, (size_t)0));
+  while (!stack.empty())
   {
-    output << "(";
-    for (size_t i = 0; i < node->get_number_of_children(); i++)
+    puu_node<selection_unit>* node       = stack.back().first;
+    size_t                    next_child = stack.back().second;
+    bool                      is_leaf    = (node->is_active() || node->get_number_of_children() < 2);
+
+    /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+    /* 1) Visit the next child if any       */
+    /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+    if (!is_leaf && next_child < node->get_number_of_children())
     {
-      inOrderNewick(node->get_child(i), node->get_insertion_time(), output);
-      if (i < node->get_number_of_children()-1)
-      {
-        output << ", ";
-      }
+      output.append(next_child == 0 ? "(" : ", ", next_child == 0 ? 1 : 2);
+      stack.back().second++;
+      stack.push_back(std::make_pair(coalescence_view ? get_coalescence_child(node, next_child) : node->get_child(next_child), (size_t)0));
+      continue;
+    }
+
+    /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+    /* 2) Else write the node and leave it  */
+    /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+    if (!is_leaf)
+    {
+      output.append(')');
     }
-    output << ")";
-    output << node->get_identifier() << ":" << node->get_insertion_time()-parent_time;
+    stack.pop_back();
+    double parent_time = (stack.empty() ? 0.0 : stack.back().first->get_insertion_time());
+    output.append(node->get_identifier());
+    output.append(':');
+    output.append(node->get_insertion_time()-parent_time);
   }
 }
 
@@ -1291,9 +6554,12 @@ void puu_tree<selection_unit>::inOrderNewick( puu_node<selection_unit>* node, do
 template <typename selection_unit>
 void puu_tree<selection_unit>::tag_tree()
 {
-  for (_iterator = _node_map.begin(); _iterator != _node_map.end(); ++_iterator)
+  for (size_t i = 0; i < _node_vector.size(); i++)
   {
-    _iterator->second->tag();
+    if (_node_vector[i] != NULL)
+    {
+      _node_vector[i]->tag();
+    }
   }
 }
 
@@ -1306,9 +6572,12 @@ void puu_tree<selection_unit>::tag_tree()
 template <typename selection_unit>
 void puu_tree<selection_unit>::untag_tree()
 {
-  for (_iterator = _node_map.begin(); _iterator != _node_map.end(); ++_iterator)
+  for (size_t i = 0; i < _node_vector.size(); i++)
   {
-    _iterator->second->untag();
+    if (_node_vector[i] != NULL)
+    {
+      _node_vector[i]->untag();
+    }
   }
 }
 